@@ -0,0 +1,106 @@
+#ifndef alu_h_
+#define alu_h_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "word.h"
+
+// Table-driven ALU shared by instructions and every engine.
+// Operation is an index into table of functions over two operands,
+// so adding an operation adds a table entry rather than a branch into calculation.
+
+/// <summary>
+/// ALU operation.
+/// Unary operations go first in UnaryOperation order, binary ones follow in BinaryOperation order.
+/// </summary>
+enum struct AluOperation : std::uint8_t {
+  MOV,
+  SXT,
+  SWB,
+  ZER,
+  ADD,
+  SUB
+};
+
+constexpr std::size_t alu_operations = 6;
+constexpr std::size_t unary_alu_operations = 4;
+
+typedef Value (*AluFunction)(Value, Value);
+
+namespace operations {
+
+/// <summary>
+/// Copy first operand.
+/// </summary>
+constexpr auto mov(const Value op1, const Value) -> Value {
+  return op1;
+}
+
+/// <summary>
+/// Sign extend low byte of first operand into a word.
+/// </summary>
+constexpr auto sxt(const Value op1, const Value) -> Value {
+  return static_cast<std::int8_t>(static_cast<std::uint8_t>(op1));
+}
+
+/// <summary>
+/// Reverse order of bytes of first operand word.
+/// </summary>
+constexpr auto swb(const Value op1, const Value) -> Value {
+  auto word = static_cast<MachineWord>(op1);
+  MachineWord result = 0;
+  for (std::size_t i = 0; i < sizeof(MachineWord); i++) {
+    result = static_cast<MachineWord>(result << 8 | (word & 0xff));
+    word = static_cast<MachineWord>(word >> 8);
+  }
+  return static_cast<Value>(result);
+}
+
+/// <summary>
+/// Zero extend low byte of first operand into a word.
+/// </summary>
+constexpr auto zer(const Value op1, const Value) -> Value {
+  return op1 & 0xff;
+}
+
+constexpr auto add(const Value op1, const Value op2) -> Value {
+  return wrapping_add(op1, op2);
+}
+
+constexpr auto sub(const Value op1, const Value op2) -> Value {
+  return wrapping_sub(op1, op2);
+}
+
+}
+
+/// <summary>
+/// Function of every AluOperation.
+/// </summary>
+inline constexpr std::array<AluFunction, alu_operations> alu_table {
+  operations::mov, operations::sxt, operations::swb, operations::zer, operations::add, operations::sub
+};
+
+/// <summary>
+/// Calculate operation over operands, unary operations ignore second operand.
+/// </summary>
+constexpr auto alu(const AluOperation op, const Value op1, const Value op2) {
+  return alu_table[static_cast<std::size_t>(op)](op1, op2);
+}
+
+/// <summary>
+/// Calculate operation known at compile time, so it's inlined by engines specialized per operation.
+/// </summary>
+template<AluOperation Op>
+constexpr auto alu(const Value op1, const Value op2) {
+  constexpr auto function = alu_table[static_cast<std::size_t>(Op)];
+  return function(op1, op2);
+}
+
+static_assert(alu(AluOperation::SXT, 0x80, 0) == -128 && alu(AluOperation::SXT, 0x17f, 0) == 127);
+static_assert(alu(AluOperation::ZER, -1, 0) == 0xff);
+static_assert(static_cast<MachineWord>(alu(AluOperation::SWB, 0x12, 0)) == static_cast<MachineWord>(MachineWord {0x12} << (word_bits - 8)));
+static_assert(alu(AluOperation::SUB, 1, 2) == -1);
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef batch_h_
+#define batch_h_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "state.h"
+#include "decoded.h"
+
+/// <summary>
+/// Independent simulation: program, initial registers and memory and count of instructions to execute.
+/// </summary>
+struct Job {
+  std::vector<Instruction> program;
+  std::array<State::word_type, 16> regs{};
+  std::array<State::word_type, 1024> data{};
+  std::size_t count{0};
+};
+
+/// <summary>
+/// Metrics of a finished job.
+/// Aligned to a cache line, so workers storing adjacent results don't share lines.
+/// </summary>
+struct alignas(64) JobResult {
+  std::size_t clk{0};
+  std::size_t fetch1{0};
+  std::size_t fetch2{0};
+  std::size_t exec{0};
+  std::size_t writeback{0};
+  std::size_t exceptions{0};
+};
+
+/// <summary>
+/// Simulate a single job on a fresh State.
+/// </summary>
+inline auto simulate(const Job& job) {
+  State state {};
+  std::memcpy(state.regs, job.regs.data(), sizeof(state.regs));
+  std::memcpy(state.data, job.data.data(), sizeof(state.data));
+  run(state, decode(job.program), job.count);
+  JobResult result;
+  result.clk = state.clk;
+  result.fetch1 = state.fetch1;
+  result.fetch2 = state.fetch2;
+  result.exec = state.exec;
+  result.writeback = state.writeback;
+  result.exceptions = state.exceptions;
+  return result;
+}
+
+/// <summary>
+/// Double ended queue of job indices owned by a worker.
+/// Owner takes jobs from the back, thieves steal from the front.
+/// </summary>
+struct alignas(64) WorkQueue {
+  std::mutex lock;
+  std::deque<std::size_t> jobs;
+
+  auto pop() -> std::optional<std::size_t> {
+    std::lock_guard guard {lock};
+    if (jobs.empty()) return std::optional<std::size_t>{};
+    const auto job = jobs.back();
+    jobs.pop_back();
+    return job;
+  }
+
+  auto steal() -> std::optional<std::size_t> {
+    std::lock_guard guard {lock};
+    if (jobs.empty()) return std::optional<std::size_t>{};
+    const auto job = jobs.front();
+    jobs.pop_front();
+    return job;
+  }
+};
+
+/// <summary>
+/// Simulate jobs on a work-stealing thread pool.
+/// Every job has its own State, so workers share nothing but queues.
+/// </summary>
+/// <param name="jobs">
+/// Jobs to simulate.
+/// </param>
+/// <param name="threads">
+/// Count of worker threads, hardware concurrency when zero.
+/// </param>
+/// <returns>
+/// Result of every job in order of jobs.
+/// </returns>
+inline auto run_batch(std::span<const Job> jobs, std::size_t threads) {
+  if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::max<std::size_t>(1, std::min(threads, jobs.size()));
+
+  std::vector<JobResult> results(jobs.size());
+  std::vector<WorkQueue> queues(threads);
+  // contiguous ranges keep neighbouring jobs on one worker until it gets stolen
+  for (std::size_t i = 0; i < jobs.size(); i++)
+    queues[i * threads / jobs.size()].jobs.push_back(i);
+
+  const auto worker = [&](const std::size_t id) {
+    for (;;) {
+      auto job = queues[id].pop();
+      for (std::size_t i = 1; !job && i < threads; i++)
+        job = queues[(id + i) % threads].steal();
+      if (!job) return;
+      results[*job] = simulate(jobs[*job]);
+    }
+  };
+
+  std::vector<std::thread> pool;
+  pool.reserve(threads - 1);
+  for (std::size_t id = 1; id < threads; id++)
+    pool.emplace_back(worker, id);
+  worker(0);
+  for (auto& thread : pool)
+    thread.join();
+  return results;
+}
+
+#endif
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "state.h"
+#include "decoded.h"
+#include "threaded.h"
+#include "multicore.h"
+
+// Host nanoseconds per simulated instruction of every instruction and addressing mode combination
+// and scaling of multi-core schedulers over host threads.
+// Results are written to stdout as JSON.
+
+struct Config {
+  /// <summary>
+  /// Count of instructions executed by a single repetition.
+  /// </summary>
+  std::size_t count{1000000};
+  std::size_t warmup{3};
+  std::size_t repetitions{31};
+  /// <summary>
+  /// Count of simulated cores of scaling benchmark, zero to skip it.
+  /// </summary>
+  std::size_t cores{64};
+};
+
+struct Case {
+  std::string name;
+  Instruction ins;
+};
+
+/// <summary>
+/// Statistics of repetitions in nanoseconds per instruction.
+/// </summary>
+struct Result {
+  double min;
+  double median;
+  double p99;
+  double max;
+};
+
+constexpr auto source(const std::size_t kind, const int value) -> Source {
+  switch (kind) {
+    case 0: return DirectSource {value};
+    case 1: return IndirectSource {value};
+    default: return ImmidiateSource {value};
+  }
+}
+
+constexpr const char* source_names[] {"direct", "indirect", "immidiate"};
+
+/// <summary>
+/// Every combination of instruction type and addressing modes of its operands.
+/// </summary>
+auto cases() {
+  std::vector<Case> result;
+  for (std::size_t op1 = 0; op1 < 3; op1++) {
+    for (std::size_t res = 0; res < 3; res++) {
+      result.push_back(Case {std::string {"unary/"} + source_names[op1] + "," + source_names[res],
+                             UnaryInstruction {source(op1, 1), source(res, 2)}});
+    }
+  }
+  for (std::size_t op1 = 0; op1 < 3; op1++) {
+    for (std::size_t op2 = 0; op2 < 3; op2++) {
+      for (std::size_t res = 0; res < 3; res++) {
+        result.push_back(Case {std::string {"binary/"} + source_names[op1] + "," + source_names[op2] + "," + source_names[res],
+                               BinaryInstruction {source(op1, 1), source(op2, 2), source(res, 3), BinaryOperation::ADD}});
+      }
+    }
+  }
+  for (std::size_t offset = 0; offset < 3; offset++) {
+    result.push_back(Case {std::string {"jump/"} + source_names[offset], JumpInstruction {source(offset, 1)}});
+  }
+  return result;
+}
+
+/// <summary>
+/// Measure engine executing program of a single repeated instruction.
+/// </summary>
+/// <param name="run">
+/// Executes count instructions on state.
+/// </param>
+template<typename Run>
+auto measure(const Config& config, Run run) {
+  std::vector<double> samples;
+  std::size_t sink = 0;
+  for (std::size_t i = 0; i < config.warmup + config.repetitions; i++) {
+    State state {};
+    const auto start = std::chrono::steady_clock::now();
+    run(state, config.count);
+    const auto end = std::chrono::steady_clock::now();
+    sink += state.clk;
+    if (i >= config.warmup)
+      samples.push_back(std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(config.count));
+  }
+  std::sort(samples.begin(), samples.end());
+  const auto at = [&samples](const double q) {
+    return samples[std::min(samples.size() - 1, static_cast<std::size_t>(q * static_cast<double>(samples.size())))];
+  };
+  // keep timed runs observable
+  if (sink == 0) fprintf(stderr, "no cycles simulated\n");
+  return Result {samples.front(), at(0.5), at(0.99), samples.back()};
+}
+
+/// <summary>
+/// Program of a core of scaling benchmark: every pass reads and writes its own line,
+/// then increments a counter in line 0 shared by every core.
+/// </summary>
+auto core_program(const std::size_t core) {
+  const auto base = static_cast<int>(core % MultiCore::line_count * MultiCore::line_size);
+  std::vector<Instruction> program;
+  for (int k = 1; k < static_cast<int>(MultiCore::line_size); k++) {
+    program.push_back(BinaryInstruction {IndirectSource {base + k}, DirectSource {k % 4}, DirectSource {k % 4}, BinaryOperation::ADD});
+    program.push_back(UnaryInstruction {DirectSource {k % 4}, IndirectSource {base + k}});
+  }
+  program.push_back(BinaryInstruction {IndirectSource {0}, ImmidiateSource {1}, IndirectSource {0}, BinaryOperation::ADD});
+  return decode(program);
+}
+
+/// <summary>
+/// Median milliseconds of simulating every core by scheduler on host threads.
+/// </summary>
+auto measure_scaling(const Config& config, const std::vector<std::vector<MicroOp>>& programs,
+                     const Scheduler scheduler, const std::size_t threads) {
+  std::vector<double> samples;
+  std::size_t sink = 0;
+  const auto repetitions = std::min<std::size_t>(config.repetitions, 5);
+  for (std::size_t i = 0; i < 1 + repetitions; i++) {
+    auto cpu = std::make_unique<MultiCore>(programs.size());
+    for (std::size_t core = 0; core < programs.size(); core++) {
+      cpu->cores[core].program = programs[core];
+      cpu->cores[core].count = config.count / programs.size() * 4;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    cpu->run(scheduler, 1000, threads);
+    const auto end = std::chrono::steady_clock::now();
+    sink += cpu->data[0];
+    if (i > 0) samples.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+  }
+  std::sort(samples.begin(), samples.end());
+  if (sink == 0) fprintf(stderr, "no shared accesses simulated\n");
+  return samples[samples.size() / 2];
+}
+
+auto parse_config(int argc, char** argv) -> std::optional<Config> {
+  Config config;
+  for (int i = 1; i < argc; i++) {
+    const std::string_view arg {argv[i]};
+    const auto number = [&arg](const std::string_view prefix) {
+      return arg.starts_with(prefix) ? parse_number(arg.substr(prefix.size())) : std::optional<std::size_t>{};
+    };
+    if (const auto count = number("--count="); count > 0) config.count = *count;
+    else if (const auto warmup = number("--warmup=")) config.warmup = *warmup;
+    else if (const auto repetitions = number("--repetitions="); repetitions > 0) config.repetitions = *repetitions;
+    else if (const auto cores = number("--cores=")) config.cores = *cores;
+    else return std::optional<Config>{};
+  }
+  return config;
+}
+
+int main(int argc, char** argv) {
+  const auto config = parse_config(argc, argv);
+  if (!config) {
+    fprintf(stderr, "usage: %s [--count=N] [--warmup=N] [--repetitions=N] [--cores=N]\n", argv[0]);
+    return 1;
+  }
+
+  printf("{\n");
+  printf("  \"count\": %zu,\n", config->count);
+  printf("  \"warmup\": %zu,\n", config->warmup);
+  printf("  \"repetitions\": %zu,\n", config->repetitions);
+  printf("  \"benchmarks\": [");
+  bool first = true;
+  const auto report = [&first](const Case& c, const char* engine, const Result& r) {
+    printf("%s\n    {\"name\": \"%s\", \"engine\": \"%s\", \"min_ns\": %.3f, \"median_ns\": %.3f, \"p99_ns\": %.3f, \"max_ns\": %.3f}",
+           first ? "" : ",", c.name.c_str(), engine, r.min, r.median, r.p99, r.max);
+    first = false;
+    fflush(stdout);
+  };
+
+  for (const auto& c : cases()) {
+    std::array<Instruction, 8> program;
+    program.fill(c.ins);
+    const auto ops = decode(program);
+    const auto threaded = compile(program);
+
+    report(c, "visitor", measure(*config, [&program](State& state, const std::size_t count) {
+      repeat(std::span<const Instruction> {program}, count, [&state](const Instruction& ins) { state.execute(ins); });
+    }));
+    report(c, "decoded", measure(*config, [&ops](State& state, const std::size_t count) {
+      run(state, ops, count);
+    }));
+    report(c, "threaded", measure(*config, [&threaded](State& state, const std::size_t count) {
+      run(state, threaded, count);
+    }));
+  }
+  printf("\n  ],\n");
+
+  // threads beyond count of cores are clamped by schedulers
+  printf("  \"host_concurrency\": %u,\n", std::thread::hardware_concurrency());
+  printf("  \"cores\": %zu,\n", config->cores);
+  printf("  \"scaling\": [");
+  first = true;
+  if (config->cores > 0) {
+    std::vector<std::vector<MicroOp>> programs;
+    for (std::size_t core = 0; core < config->cores; core++)
+      programs.push_back(core_program(core));
+    for (const auto& [scheduler, name] : {std::pair {Scheduler::QUANTUM, "quantum"}, std::pair {Scheduler::CONSERVATIVE, "conservative"}}) {
+      double serial = 0;
+      for (std::size_t threads = 1; threads <= 64; threads *= 2) {
+        const auto ms = measure_scaling(*config, programs, scheduler, threads);
+        if (threads == 1) serial = ms;
+        printf("%s\n    {\"scheduler\": \"%s\", \"threads\": %zu, \"median_ms\": %.3f, \"speedup\": %.3f}",
+               first ? "" : ",", name, threads, ms, serial / ms);
+        first = false;
+        fflush(stdout);
+      }
+    }
+  }
+  printf("\n  ]\n}\n");
+  return 0;
+}
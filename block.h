@@ -0,0 +1,210 @@
+#ifndef block_h_
+#define block_h_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "state.h"
+#include "decoded.h"
+
+/// <summary>
+/// Summary of a straight-line instruction sequence.
+/// Sequence ends after JumpInstruction or at the end of program.
+/// </summary>
+struct BlockSummary {
+  /// <summary>
+  /// Count of instructions in block.
+  /// </summary>
+  std::size_t length;
+  std::size_t clk;
+  std::size_t fetch1;
+  std::size_t fetch2;
+  std::size_t writeback;
+  std::size_t exceptions;
+  /// <summary>
+  /// Fused transform of block: index of its first micro-op in BlockCache::fused and count of them.
+  /// </summary>
+  std::size_t fused_begin;
+  std::size_t fused_length;
+};
+
+/// <summary>
+/// Register or memory cell holding a value known while fusing block.
+/// </summary>
+struct KnownValue {
+  SourceKind kind;
+  Value index;
+  Value value;
+};
+
+/// <summary>
+/// Compose straight-line micro-ops into a shorter sequence with the same effect on registers and memory.
+/// Block addresses only statically known locations, so values stored by block are propagated forward,
+/// operations over immidiates are folded and stores overwritten before being read are dropped.
+/// Results stored into ImmidiateSource change nothing and are dropped too, their exceptions stay in block cost.
+/// </summary>
+/// <param name="block">
+/// Micro-ops of block.
+/// </param>
+/// <returns>
+/// Micro-ops of fused transform, costs are not set.
+/// </returns>
+constexpr auto fuse(std::span<const MicroOp> block) {
+  const auto same = [](const SourceKind kind, const Value index, const SourceKind other, const Value other_index) {
+    return kind != SourceKind::IMMIDIATE && kind == other && index == other_index;
+  };
+
+  std::vector<MicroOp> ops;
+  std::vector<KnownValue> known;
+  const auto rewrite = [&known, &same](SourceKind& kind, Value& value) {
+    for (const auto& k : known) {
+      if (!same(kind, value, k.kind, k.index)) continue;
+      kind = SourceKind::IMMIDIATE;
+      value = k.value;
+      return;
+    }
+  };
+  for (const auto& original : block) {
+    auto op = original;
+    op.cost = Cost {};
+    rewrite(op.op1_kind, op.op1);
+    rewrite(op.op2_kind, op.op2);
+    if (op.res_kind == SourceKind::IMMIDIATE) continue;
+    if (op.op1_kind == SourceKind::IMMIDIATE && op.op2_kind == SourceKind::IMMIDIATE)
+      op = MicroOp {OpCode::MOV, SourceKind::IMMIDIATE, SourceKind::IMMIDIATE, op.res_kind, calculate(op.op, op.op1, op.op2), 0, op.res, Cost {}};
+    std::erase_if(known, [&op, &same](const KnownValue& k) { return same(k.kind, k.index, op.res_kind, op.res); });
+    if (op.op == OpCode::MOV && op.op1_kind == SourceKind::IMMIDIATE)
+      known.push_back(KnownValue {op.res_kind, op.res, static_cast<Value>(static_cast<State::word_type>(op.op1))});
+    ops.push_back(op);
+  }
+
+  // every location is read after block, so the last store of a location is always kept
+  std::vector<MicroOp> result;
+  std::vector<KnownValue> overwritten;
+  for (auto i = ops.rbegin(); i != ops.rend(); i++) {
+    const auto is = [&same, i](const KnownValue& k) { return same(k.kind, k.index, i->res_kind, i->res); };
+    if (std::find_if(overwritten.begin(), overwritten.end(), is) != overwritten.end()) continue;
+    overwritten.push_back(KnownValue {i->res_kind, i->res, 0});
+    std::erase_if(overwritten, [&same, i](const KnownValue& k) {
+      return same(k.kind, k.index, i->op1_kind, i->op1) || same(k.kind, k.index, i->op2_kind, i->op2);
+    });
+    result.push_back(*i);
+  }
+  return std::vector<MicroOp> {result.rbegin(), result.rend()};
+}
+
+/// <summary>
+/// Pre-decoded program with block summaries computed on first execution of every block.
+/// </summary>
+template<std::size_t N>
+struct BlockCache {
+  std::array<MicroOp, N> program;
+  std::array<std::optional<BlockSummary>, N> blocks{};
+  /// <summary>
+  /// Fused transforms of summarized blocks.
+  /// </summary>
+  std::vector<MicroOp> fused{};
+
+  /// <summary>
+  /// Summarize block starting at instruction.
+  /// </summary>
+  /// <param name="begin">
+  /// Index of first instruction of block.
+  /// </param>
+  /// <returns>
+  /// Block summary.
+  /// </returns>
+  constexpr auto summarize(const std::size_t begin) const {
+    BlockSummary block {};
+    for (auto i = begin; i < N; i++) {
+      const auto& cost = program[i].cost;
+      block.length++;
+      block.clk += cost.clk;
+      block.fetch1 += cost.fetch1;
+      block.fetch2 += cost.fetch2;
+      block.writeback += cost.writeback;
+      block.exceptions += cost.exceptions;
+      if (program[i].op == OpCode::JMP) break;
+    }
+    return block;
+  }
+
+  /// <summary>
+  /// Get summary of block starting at instruction, computing it and its fused transform on first use.
+  /// </summary>
+  constexpr auto summary(const std::size_t begin) -> const BlockSummary& {
+    if (!blocks[begin]) [[unlikely]] {
+      auto block = summarize(begin);
+      const auto ops = fuse(std::span<const MicroOp> {program}.subspan(begin, block.length));
+      block.fused_begin = fused.size();
+      block.fused_length = ops.size();
+      fused.insert(fused.end(), ops.begin(), ops.end());
+      blocks[begin] = block;
+    }
+    return *blocks[begin];
+  }
+};
+
+template<std::size_t N>
+constexpr auto make_block_cache(const std::array<Instruction, N>& program) {
+  return BlockCache<N> {decode(program)};
+}
+
+/// <summary>
+/// Execute block with a single metrics update and its fused transform.
+/// </summary>
+/// <param name="state">
+/// State to execute on.
+/// </param>
+/// <param name="block">
+/// Summary of block.
+/// </param>
+/// <param name="fused">
+/// First micro-op of fused transform of block.
+/// </param>
+constexpr auto execute(State& state, const BlockSummary& block, const MicroOp* fused) {
+  state.clk += block.clk;
+  state.fetch1 += block.fetch1;
+  state.fetch2 += block.fetch2;
+  state.writeback += block.writeback;
+  state.exceptions += block.exceptions;
+  for (std::size_t i = 0; i < block.fused_length; i++)
+    transform(state, fused[i]);
+}
+
+/// <summary>
+/// Execute program block by block.
+/// Registers, memory and metrics are bit-identical to instruction by instruction execution.
+/// </summary>
+/// <param name="state">
+/// State to execute on.
+/// </param>
+/// <param name="cache">
+/// Program with block summaries.
+/// </param>
+/// <param name="count">
+/// Count of instructions to execute, program is repeated from the start when ends.
+/// </param>
+template<std::size_t N>
+constexpr auto run(State& state, BlockCache<N>& cache, const std::size_t count) {
+  if constexpr (N == 0) return;
+  std::size_t pc = 0;
+  for (auto remaining = count; remaining > 0;) {
+    const auto& block = cache.summary(pc);
+    if (block.length > remaining) [[unlikely]] {
+      execute(state, cache.program[pc]);
+      pc = pc + 1 < N ? pc + 1 : 0;
+      remaining--;
+      continue;
+    }
+    execute(state, block, cache.fused.data() + block.fused_begin);
+    pc = pc + block.length < N ? pc + block.length : 0;
+    remaining -= block.length;
+  }
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef branch_h_
+#define branch_h_
+
+#include <array>
+#include <cstddef>
+
+#include "word.h"
+
+/// <summary>
+/// Direct-mapped branch target buffer.
+/// Jumps are unconditional, so a jump is predicted when its target is cached.
+/// Mispredicted jump flushes fetched instructions and costs extra cycles.
+/// </summary>
+struct BranchTargetBuffer {
+  static constexpr std::size_t size = 64;
+
+  struct Entry {
+    bool valid;
+    std::size_t pc;
+    std::size_t target;
+  };
+
+  std::array<Entry, size> entries{};
+  /// <summary>
+  /// Extra cycles of mispredicted jump.
+  /// </summary>
+  std::size_t penalty{2};
+
+  // Metrics
+  std::size_t hits{0};
+  std::size_t misses{0};
+
+  /// <summary>
+  /// Predict jump and update cached target.
+  /// </summary>
+  /// <param name="pc">
+  /// Program counter of jump.
+  /// </param>
+  /// <param name="target">
+  /// Resolved jump target.
+  /// </param>
+  /// <returns>
+  /// Extra cycles of jump, zero when predicted.
+  /// </returns>
+  constexpr auto predict(const std::size_t pc, const std::size_t target) {
+    auto& entry = entries[pc % size];
+    if (entry.valid && entry.pc == pc && entry.target == target) {
+      hits++;
+      return std::size_t{0};
+    }
+    misses++;
+    entry = Entry {true, pc, target};
+    return penalty;
+  }
+};
+
+/// <summary>
+/// Resolve relative jump target.
+/// </summary>
+/// <returns>
+/// Target program counter, out of program when jump leaves it.
+/// </returns>
+constexpr auto jump_target(const std::size_t pc, const Value offset) {
+  return pc + static_cast<std::size_t>(offset);
+}
+
+#endif
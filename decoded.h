@@ -0,0 +1,333 @@
+#ifndef decoded_h_
+#define decoded_h_
+
+#include <array>
+#include <span>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "utilities.h"
+#include "source.h"
+#include "instruction.h"
+#include "state.h"
+
+enum struct OpCode : std::uint8_t {
+  MOV,
+  ADD,
+  SUB,
+  JMP,
+  SXT,
+  SWB,
+  ZER
+};
+
+constexpr std::size_t op_codes = 7;
+
+/// <summary>
+/// ALU operation of every OpCode, JMP adds offset to regs[0].
+/// </summary>
+inline constexpr std::array<AluOperation, op_codes> op_code_operations {
+  AluOperation::MOV, AluOperation::ADD, AluOperation::SUB, AluOperation::ADD,
+  AluOperation::SXT, AluOperation::SWB, AluOperation::ZER
+};
+
+constexpr auto alu_operation(const OpCode op) {
+  return op_code_operations[static_cast<std::size_t>(op)];
+}
+
+/// <summary>
+/// OpCode of every UnaryOperation.
+/// </summary>
+inline constexpr std::array<OpCode, unary_alu_operations> unary_op_codes {
+  OpCode::MOV, OpCode::SXT, OpCode::SWB, OpCode::ZER
+};
+
+constexpr auto op_code(const UnaryOperation op) {
+  return unary_op_codes[static_cast<std::size_t>(op)];
+}
+
+constexpr auto op_code(const BinaryOperation op) {
+  return op == BinaryOperation::ADD ? OpCode::ADD : OpCode::SUB;
+}
+
+/// <summary>
+/// Addressing mode of an operand.
+/// Order matches Source alternatives, so Source::index() could be used directly.
+/// </summary>
+enum struct SourceKind : std::uint8_t {
+  DIRECT,
+  INDIRECT,
+  IMMIDIATE
+};
+
+/// <summary>
+/// Cycle and stage counters increment of a single instruction.
+/// Depends only on addressing modes, so it's computed once on decode.
+/// </summary>
+struct Cost {
+  std::uint8_t clk;
+  std::uint8_t fetch1;
+  std::uint8_t fetch2;
+  std::uint8_t writeback;
+  std::uint8_t exceptions;
+};
+
+/// <summary>
+/// Flat pre-decoded instruction.
+/// Every Instruction is lowered into a single operation over two operands and a result:
+/// UnaryInstruction reads only first operand and applies its operation,
+/// JumpInstruction adds offset to second operand and writes it into regs[0]
+/// exactly like visitor engine does.
+/// Operands are immidiate values or locations, result is always a location.
+/// </summary>
+struct MicroOp {
+  OpCode op;
+  SourceKind op1_kind;
+  SourceKind op2_kind;
+  SourceKind res_kind;
+  Value op1;
+  Value op2;
+  int res;
+  Cost cost;
+};
+
+static_assert(std::is_trivially_copyable_v<MicroOp>);
+
+constexpr auto kind_of(const Source& source) {
+  return static_cast<SourceKind>(source.index());
+}
+
+constexpr auto value_of(const Source& source) {
+  return std::visit(overloaded {
+    [](const DirectSource& s) -> Value { return s.reg; },
+    [](const IndirectSource& s) -> Value { return s.addr; },
+    [](const ImmidiateSource& s) { return s.value; }
+  }, source);
+}
+
+/// <summary>
+/// Register index or memory address of location, immidiate result is never stored.
+/// </summary>
+constexpr auto index_of(const Source& source) {
+  return static_cast<int>(value_of(source));
+}
+
+/// <summary>
+/// Account result store of an instruction which operands are already fetched.
+/// DirectSource is stored on the same cycle,
+/// IndirectSource takes an extra Writeback cycle,
+/// ImmidiateSource takes an extra Exception cycle.
+/// </summary>
+constexpr auto add_store_cost(Cost& cost, const SourceKind res) {
+  switch (res) {
+    case SourceKind::DIRECT: break;
+    case SourceKind::INDIRECT: cost.clk++; cost.writeback++; break;
+    case SourceKind::IMMIDIATE: cost.clk++; cost.exceptions++; break;
+  }
+}
+
+/// <summary>
+/// Calculate cost of micro-op with given operation and addressing modes.
+/// </summary>
+/// <returns>
+/// Counters increment matching State::execute of an original instruction.
+/// </returns>
+constexpr auto cost_of(const OpCode op, const SourceKind op1, const SourceKind op2, const SourceKind res) {
+  Cost cost {1, 0, 0, 0, 0};
+  if (op1 == SourceKind::INDIRECT) {
+    cost.clk++;
+    cost.fetch1++;
+  }
+  switch (op) {
+    case OpCode::MOV:
+    case OpCode::SXT:
+    case OpCode::SWB:
+    case OpCode::ZER:
+      add_store_cost(cost, res);
+      break;
+    case OpCode::ADD:
+    case OpCode::SUB:
+      if (op2 == SourceKind::INDIRECT) {
+        // Op2Fetch always yields Writeback event regardless of result source,
+        // Writeback into ImmidiateSource raises an Exception on the next cycle
+        cost.clk += 2;
+        cost.fetch2++;
+        cost.writeback++;
+        if (res == SourceKind::IMMIDIATE) {
+          cost.clk++;
+          cost.exceptions++;
+        }
+      } else {
+        add_store_cost(cost, res);
+      }
+      break;
+    case OpCode::JMP:
+      // Op1Fetch stores fetched offset as is on Writeback cycle
+      if (op1 == SourceKind::INDIRECT) {
+        cost.clk++;
+        cost.writeback++;
+      }
+      break;
+  }
+  return cost;
+}
+
+/// <summary>
+/// Decode instruction into a flat micro-op.
+/// </summary>
+/// <param name="ins">
+/// Instruction to decode.
+/// </param>
+/// <returns>
+/// MicroOp with precomputed cost, which execution matches State::execute.
+/// </returns>
+constexpr auto decode(const Instruction& ins) {
+  auto op = std::visit(overloaded {
+    [](const UnaryInstruction& i) {
+      return MicroOp {op_code(i.op), kind_of(i.op1_addr), SourceKind::IMMIDIATE, kind_of(i.res_addr),
+                      value_of(i.op1_addr), 0, index_of(i.res_addr), Cost {}};
+    },
+    [](const BinaryInstruction& i) {
+      return MicroOp {op_code(i.op),
+                      kind_of(i.op1_addr), kind_of(i.op2_addr), kind_of(i.res_addr),
+                      value_of(i.op1_addr), value_of(i.op2_addr), index_of(i.res_addr), Cost {}};
+    },
+    [](const JumpInstruction& i) {
+      // Fetched from memory offset is stored as is, otherwise it's added to regs[0]
+      const auto offset = kind_of(i.offset_addr);
+      return MicroOp {OpCode::JMP, offset, offset == SourceKind::INDIRECT ? SourceKind::IMMIDIATE : SourceKind::DIRECT,
+                      SourceKind::DIRECT, value_of(i.offset_addr), 0, 0, Cost {}};
+    }
+  }, ins);
+  op.cost = cost_of(op.op, op.op1_kind, op.op2_kind, op.res_kind);
+  return op;
+}
+
+template<std::size_t N>
+constexpr auto decode(const std::array<Instruction, N>& program) {
+  std::array<MicroOp, N> ops{};
+  for (std::size_t i = 0; i < N; i++)
+    ops[i] = decode(program[i]);
+  return ops;
+}
+
+inline auto decode(std::span<const Instruction> program) {
+  std::vector<MicroOp> ops;
+  ops.reserve(program.size());
+  for (const auto& ins : program)
+    ops.push_back(decode(ins));
+  return ops;
+}
+
+/// <summary>
+/// Read operand of micro-op.
+/// </summary>
+constexpr auto load(const State& state, const SourceKind kind, const Value value) {
+  switch (kind) {
+    case SourceKind::DIRECT: return static_cast<Value>(state.regs[value]);
+    case SourceKind::INDIRECT: return static_cast<Value>(state.data[value]);
+    case SourceKind::IMMIDIATE: return value;
+  }
+  return Value {0};
+}
+
+/// <summary>
+/// Store result of micro-op.
+/// ImmidiateSource is ignored, it's accounted as exception in cost.
+/// </summary>
+constexpr auto store(State& state, const SourceKind kind, const int addr, const Value value) {
+  switch (kind) {
+    case SourceKind::DIRECT: state.regs[addr] = value; break;
+    case SourceKind::INDIRECT: state.data[addr] = value; break;
+    case SourceKind::IMMIDIATE: break;
+  }
+}
+
+/// <summary>
+/// Calculate result of micro-op from fetched operands.
+/// </summary>
+constexpr auto calculate(const OpCode op, const Value op1, const Value op2) {
+  return alu(alu_operation(op), op1, op2);
+}
+
+/// <summary>
+/// Apply pre-decoded instruction to registers and memory only.
+/// Metrics are not changed.
+/// </summary>
+/// <param name="state">
+/// State to execute on.
+/// </param>
+/// <param name="op">
+/// Micro-op to apply.
+/// </param>
+constexpr auto transform(State& state, const MicroOp& op) {
+  const auto op1 = load(state, op.op1_kind, op.op1);
+  const auto op2 = load(state, op.op2_kind, op.op2);
+  store(state, op.res_kind, op.res, calculate(op.op, op1, op2));
+}
+
+/// <summary>
+/// Execute pre-decoded instruction.
+/// Registers, memory and metrics are changed exactly as State::execute does.
+/// </summary>
+/// <param name="state">
+/// State to execute on.
+/// </param>
+/// <param name="op">
+/// Micro-op to execute.
+/// </param>
+constexpr auto execute(State& state, const MicroOp& op) {
+  state.clk += op.cost.clk;
+  state.fetch1 += op.cost.fetch1;
+  state.fetch2 += op.cost.fetch2;
+  state.writeback += op.cost.writeback;
+  state.exceptions += op.cost.exceptions;
+  transform(state, op);
+}
+
+/// <summary>
+/// Execute program in a loop over pre-decoded instructions.
+/// </summary>
+/// <param name="state">
+/// State to execute on.
+/// </param>
+/// <param name="program">
+/// Pre-decoded program.
+/// </param>
+/// <param name="count">
+/// Count of instructions to execute, program is repeated from the start when ends.
+/// </param>
+constexpr auto run(State& state, std::span<const MicroOp> program, const std::size_t count) {
+  repeat(program, count, [&state](const MicroOp& op) { execute(state, op); });
+}
+
+/// <summary>
+/// Execute pre-decoded instruction at program counter and move program counter.
+/// Program counter, branch target buffer and metrics are changed exactly as State::step does.
+/// </summary>
+/// <param name="state">
+/// State to execute on.
+/// </param>
+/// <param name="program">
+/// Pre-decoded program.
+/// </param>
+/// <returns>
+/// False when program counter is out of program and program is halted.
+/// </returns>
+constexpr auto step(State& state, std::span<const MicroOp> program) {
+  if (state.pc >= program.size()) return false;
+  const auto& op = program[state.pc];
+  if (op.op == OpCode::JMP) {
+    const auto target = jump_target(state.pc, load(state, op.op1_kind, op.op1));
+    execute(state, op);
+    state.clk += state.btb.predict(state.pc, target);
+    state.pc = target;
+  } else {
+    execute(state, op);
+    state.pc++;
+  }
+  return state.pc < program.size();
+}
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef evaluate_h_
+#define evaluate_h_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "source.h"
+#include "instruction.h"
+#include "state.h"
+
+/// <summary>
+/// Final registers, memory and metrics of a program evaluated at compile time.
+/// </summary>
+template<typename S>
+struct Evaluation {
+  std::array<typename S::word_type, S::reg_count> regs;
+  std::array<typename S::word_type, S::mem_size> data;
+  std::size_t clk;
+  std::size_t fetch1;
+  std::size_t fetch2;
+  std::size_t exec;
+  std::size_t writeback;
+  std::size_t exceptions;
+};
+
+template<typename S>
+constexpr auto evaluation(const S& state) {
+  Evaluation<S> result {{}, {}, state.clk, state.fetch1, state.fetch2, state.exec, state.writeback, state.exceptions};
+  for (std::size_t i = 0; i < S::reg_count; i++)
+    result.regs[i] = state.regs[i];
+  for (std::size_t i = 0; i < S::mem_size; i++)
+    result.data[i] = state.data[i];
+  return result;
+}
+
+/// <summary>
+/// Execute fully static program at compile time.
+/// Program is executed by visitor engine, so results are exactly the ones of State::execute.
+/// </summary>
+/// <param name="program">
+/// Program to execute.
+/// </param>
+/// <param name="count">
+/// Count of instructions to execute, program is repeated from the start when ends.
+/// </param>
+/// <param name="state">
+/// Initial state.
+/// </param>
+/// <returns>
+/// Evaluation with final registers, memory and metrics.
+/// </returns>
+template<typename S = State, std::size_t N>
+consteval auto evaluate(const std::array<Instruction, N>& program, const std::size_t count, S state = S{}) {
+  for (std::size_t i = 0; i < count; i++)
+    state.execute(program[i % N]);
+  return evaluation(state);
+}
+
+/// <summary>
+/// Execute fully static program at compile time by program counter until it halts.
+/// </summary>
+/// <param name="program">
+/// Program to execute.
+/// </param>
+/// <param name="limit">
+/// Maximum count of instructions to execute.
+/// </param>
+/// <param name="state">
+/// Initial state.
+/// </param>
+/// <returns>
+/// Evaluation with final registers, memory and metrics.
+/// </returns>
+template<typename S = State, std::size_t N>
+consteval auto evaluate_steps(const std::array<Instruction, N>& program, const std::size_t limit, S state = S{}) {
+  for (std::size_t i = 0; i < limit && state.step(program); i++) {}
+  return evaluation(state);
+}
+
+// Golden fixtures, checked on every build.
+
+namespace fixtures {
+
+/// <summary>
+/// Built-in program of simulator.
+/// </summary>
+constexpr std::array<Instruction, 8> sample {
+  UnaryInstruction { ImmidiateSource{1}, DirectSource{1} },
+  UnaryInstruction { ImmidiateSource{2}, DirectSource{2} },
+
+  UnaryInstruction { DirectSource{1}, IndirectSource{1} },
+  UnaryInstruction { DirectSource{2}, IndirectSource{2} },
+
+  BinaryInstruction { IndirectSource {1}, IndirectSource{2}, IndirectSource{3}, BinaryOperation::ADD },
+  UnaryInstruction { IndirectSource {3}, DirectSource {3} },
+  BinaryInstruction { DirectSource {1}, DirectSource {3}, DirectSource {1}, BinaryOperation::ADD },
+  JumpInstruction { DirectSource {1} }
+};
+
+/// <summary>
+/// Every way of writing result into ImmidiateSource.
+/// </summary>
+constexpr std::array<Instruction, 4> immidiate_results {
+  UnaryInstruction { ImmidiateSource{1}, ImmidiateSource{0} },
+  UnaryInstruction { IndirectSource{1}, ImmidiateSource{0} },
+  BinaryInstruction { DirectSource{1}, ImmidiateSource{1}, ImmidiateSource{0}, BinaryOperation::ADD },
+  BinaryInstruction { DirectSource{1}, IndirectSource{1}, ImmidiateSource{0}, BinaryOperation::SUB }
+};
+
+/// <summary>
+/// Unary operations over immidiate and fetched operands.
+/// </summary>
+constexpr std::array<Instruction, 4> unary_operations {
+  UnaryInstruction { ImmidiateSource{0x80}, DirectSource{1}, UnaryOperation::SXT },
+  UnaryInstruction { ImmidiateSource{0x1ff}, DirectSource{2}, UnaryOperation::ZER },
+  UnaryInstruction { ImmidiateSource{0x12}, IndirectSource{1}, UnaryOperation::SWB },
+  UnaryInstruction { IndirectSource{1}, DirectSource{3}, UnaryOperation::SWB }
+};
+
+}
+
+static_assert([] {
+  constexpr auto r = evaluate(fixtures::sample, fixtures::sample.size());
+  return r.clk == 14 && r.fetch1 == 2 && r.fetch2 == 1 && r.writeback == 3 && r.exceptions == 0 &&
+         r.regs[0] == 4 && r.regs[1] == 4 && r.regs[2] == 2 && r.regs[3] == 3 &&
+         r.data[1] == 1 && r.data[2] == 2 && r.data[3] == 3;
+}());
+
+static_assert([] {
+  constexpr auto r = evaluate(fixtures::sample, 800);
+  return r.clk == 1400 && r.fetch1 == 200 && r.fetch2 == 100 && r.writeback == 300 && r.regs[0] == static_cast<MachineWord>(400);
+}());
+
+static_assert([] {
+  constexpr auto r = evaluate(fixtures::immidiate_results, fixtures::immidiate_results.size());
+  return r.clk == 11 && r.fetch1 == 1 && r.fetch2 == 1 && r.writeback == 1 && r.exceptions == 4 &&
+         r.regs == decltype(r.regs){};
+}());
+
+static_assert([] {
+  State state {};
+  const auto r = state.run(fixtures::sample, RunBudget {800});
+  return r.executed == 800 && r.cycles == 1400 && r.reason == StopReason::INSTRUCTIONS && state.clk == 1400;
+}());
+
+static_assert([] {
+  State state {};
+  const auto r = state.run(fixtures::sample, RunBudget {800, 20});
+  return r.executed == 12 && r.cycles == 20 && r.reason == StopReason::CYCLES;
+}());
+
+static_assert([] {
+  State state {};
+  const auto r = state.run(fixtures::immidiate_results, RunBudget {100, 100, true});
+  return r.executed == 1 && r.reason == StopReason::EXCEPTION && r.exception == ExceptionCode::IMMIDIATE_RESULT &&
+         state.exceptions == 1;
+}());
+
+static_assert([] {
+  // run stopped by cycles and resumed from where it stopped matches a single run
+  State state {};
+  const auto first = state.run(fixtures::sample, RunBudget {800, 20});
+  const auto second = state.run(fixtures::sample, RunBudget {800 - first.executed}, first.next);
+  constexpr auto r = evaluate(fixtures::sample, 800);
+  return first.next == 4 && second.reason == StopReason::INSTRUCTIONS && second.next == 0 &&
+         state.clk == r.clk && state.regs[0] == r.regs[0] && state.regs[1] == r.regs[1];
+}());
+
+static_assert([] {
+  State state {};
+  const auto r = state.run_steps(fixtures::sample, RunBudget {100});
+  // regs[0] is 4 when jump executes, so program counter leaves program
+  return r.reason == StopReason::HALTED && r.executed == 8 && r.next == 11 && state.pc == 11;
+}());
+
+static_assert([] {
+  // the last instruction both raises an exception and leaves program
+  constexpr std::array<Instruction, 1> program {UnaryInstruction {ImmidiateSource {1}, ImmidiateSource {2}}};
+  State state {};
+  const auto r = state.run_steps(program, RunBudget {100, 100, true});
+  return r.reason == StopReason::EXCEPTION && r.exception == ExceptionCode::IMMIDIATE_RESULT && r.executed == 1;
+}());
+
+static_assert([] {
+  constexpr auto r = evaluate(fixtures::unary_operations, fixtures::unary_operations.size());
+  return r.clk == 6 && r.fetch1 == 1 && r.fetch2 == 0 && r.writeback == 1 && r.exceptions == 0 &&
+         r.regs[1] == static_cast<MachineWord>(-128) && r.regs[2] == 0xff && r.regs[3] == 0x12 &&
+         r.data[1] == static_cast<MachineWord>(MachineWord {0x12} << (word_bits - 8));
+}());
+
+#endif
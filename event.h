@@ -1,33 +1,67 @@
 #ifndef event_h_
 #define event_h_
 
-#include <variant>
-#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
 
-struct Op1Fetch {
-  const Instruction ins;
-};
+#include "word.h"
 
-struct Op2Fetch {
-  const Instruction ins;
-  int op1;
-};
+// Events are compact records passed from cycle to cycle by value,
+// instruction in flight is passed along with them, so stage transitions never copy instruction payload.
 
-struct Execution {
-  const Instruction ins;
-  int op1;
-  int op2;
+enum struct EventKind : std::uint32_t {
+  OP1_FETCH,
+  OP2_FETCH,
+  WRITEBACK,
+  EXCEPTION,
+  /// <summary>
+  /// Instruction is finished, there's no event on the next cycle.
+  /// </summary>
+  NONE
 };
 
-struct Writeback {
-  const Instruction ins;
-  int res;
+enum struct ExceptionCode : std::int32_t {
+  IMMIDIATE_RESULT,
+  UNARY_OP2_FETCH,
+  JUMP_OP2_FETCH
 };
 
-struct Exception {
-  const std::string_view msg;
+/// <summary>
+/// Resolve exception code into message, only done when exception is reported.
+/// </summary>
+constexpr auto exception_message(const ExceptionCode code) -> std::string_view {
+  switch (code) {
+    case ExceptionCode::IMMIDIATE_RESULT: return "ImmidiateSource is prohibited as result source";
+    case ExceptionCode::UNARY_OP2_FETCH: return "UnaryInstruction pipelined Op2Fetch";
+    case ExceptionCode::JUMP_OP2_FETCH: return "JumpInstruction pipelined Op2Fetch";
+  }
+  return "unknown exception";
+}
+
+/// <summary>
+/// Compact event of a next cycle: kind and payload of a word.
+/// Payload is first operand for Op2Fetch, result for Writeback,
+/// ExceptionCode for Exception and unused otherwise.
+/// </summary>
+struct Event {
+  EventKind kind;
+  Value payload;
 };
 
-typedef std::variant<Op1Fetch, Op2Fetch, Execution, Writeback, Exception> ExecutionEvent;
+// 8 bytes for words up to 16 bits, 16 bytes for wider words with kind padded to payload
+static_assert(sizeof(Event) == 2 * sizeof(Value));
+static_assert(std::is_trivially_copyable_v<Event>);
+
+constexpr auto make_event(const EventKind kind, const Value payload = 0) {
+  return Event {kind, payload};
+}
+
+constexpr auto make_exception(const ExceptionCode code) {
+  return make_event(EventKind::EXCEPTION, static_cast<Value>(code));
+}
+
+constexpr Event no_event {EventKind::NONE, 0};
 
 #endif
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "state.h"
+#include "decoded.h"
+#include "threaded.h"
+#include "block.h"
+#include "jit.h"
+#include "optimizer.h"
+#include "generator.h"
+
+// Differential fuzzing of engines: random programs are executed by every engine on every host thread,
+// final registers, memory and metrics of every engine are compared with visitor engine.
+// Divergences are written to stdout, exit code is non-zero when any engine diverges.
+
+constexpr std::size_t program_length = 32;
+
+struct Config {
+  /// <summary>
+  /// Count of programs to generate.
+  /// </summary>
+  std::size_t programs{10000};
+  /// <summary>
+  /// Count of instructions executed of every program.
+  /// </summary>
+  std::size_t count{1000};
+  /// <summary>
+  /// Seed of the first program, following programs take following seeds.
+  /// </summary>
+  std::uint64_t seed{1};
+  /// <summary>
+  /// Count of worker threads, hardware concurrency when zero.
+  /// </summary>
+  std::size_t threads{0};
+};
+
+struct Divergence {
+  std::uint64_t seed;
+  const char* engine;
+  const char* field;
+};
+
+/// <summary>
+/// First field of state differing from reference.
+/// </summary>
+/// <param name="metrics">
+/// Compare metrics too, functional engine changes registers and memory only.
+/// </param>
+auto diverges(const State& reference, const State& state, const bool metrics) -> const char* {
+  if (!std::equal(std::begin(reference.regs), std::end(reference.regs), std::begin(state.regs))) return "regs";
+  if (!std::equal(std::begin(reference.data), std::end(reference.data), std::begin(state.data))) return "data";
+  if (!metrics) return nullptr;
+  if (reference.clk != state.clk) return "clk";
+  if (reference.fetch1 != state.fetch1) return "fetch1";
+  if (reference.fetch2 != state.fetch2) return "fetch2";
+  if (reference.exec != state.exec) return "exec";
+  if (reference.writeback != state.writeback) return "writeback";
+  if (reference.exceptions != state.exceptions) return "exceptions";
+  return nullptr;
+}
+
+/// <summary>
+/// Execute program of seed by every engine.
+/// </summary>
+/// <returns>
+/// False when JIT couldn't compile program and wasn't compared.
+/// </returns>
+auto check(const Config& config, const std::uint64_t seed, std::vector<Divergence>& divergences) {
+  const auto program = generate<program_length>(seed);
+  auto reference = std::make_unique<State>();
+  reference->run(program, RunBudget {config.count});
+
+  auto state = std::make_unique<State>();
+  const auto compare = [&](const char* engine, const bool metrics, auto&& run) {
+    *state = State {};
+    run(*state);
+    if (const auto field = diverges(*reference, *state, metrics)) divergences.push_back(Divergence {seed, engine, field});
+  };
+
+  const auto ops = decode(program);
+  compare("decoded", true, [&](State& s) { run(s, ops, config.count); });
+  const auto threaded = compile(program);
+  compare("threaded", true, [&](State& s) { run(s, threaded, config.count); });
+  auto cache = make_block_cache(program);
+  compare("block", true, [&](State& s) { run(s, cache, config.count); });
+  const auto functional = make_functional_program(program);
+  compare("functional", false, [&](State& s) { run(s, functional, config.count); });
+  auto jit = make_jit_program(program);
+  if (!jit.code) return false;
+  compare("jit", true, [&](State& s) { run(s, jit, config.count); });
+  return true;
+}
+
+auto parse_config(int argc, char** argv) -> std::optional<Config> {
+  Config config;
+  for (int i = 1; i < argc; i++) {
+    const std::string_view arg {argv[i]};
+    const auto number = [&arg](const std::string_view prefix) {
+      return arg.starts_with(prefix) ? parse_number(arg.substr(prefix.size())) : std::optional<std::size_t>{};
+    };
+    if (const auto programs = number("--programs=")) config.programs = *programs;
+    else if (const auto count = number("--count=")) config.count = *count;
+    else if (const auto seed = number("--seed=")) config.seed = *seed;
+    else if (const auto threads = number("--threads=")) config.threads = *threads;
+    else return std::optional<Config>{};
+  }
+  return config;
+}
+
+int main(int argc, char** argv) {
+  const auto config = parse_config(argc, argv);
+  if (!config) {
+    fprintf(stderr, "usage: %s [--programs=N] [--count=N] [--seed=N] [--threads=N]\n", argv[0]);
+    return 1;
+  }
+
+  const auto threads = std::max<std::size_t>(1, config->threads > 0 ? config->threads : std::thread::hardware_concurrency());
+  std::atomic<std::size_t> next {0};
+  std::atomic<bool> jit {true};
+  std::vector<std::vector<Divergence>> found(threads);
+
+  const auto start = std::chrono::steady_clock::now();
+  {
+    std::vector<std::jthread> workers;
+    for (std::size_t t = 0; t < threads; t++) {
+      workers.emplace_back([&, t] {
+        for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < config->programs;) {
+          if (!check(*config, config->seed + i, found[t])) jit.store(false, std::memory_order_relaxed);
+        }
+      });
+    }
+  }
+  const auto end = std::chrono::steady_clock::now();
+  const auto seconds = std::chrono::duration<double>(end - start).count();
+
+  std::vector<Divergence> divergences;
+  for (const auto& f : found)
+    divergences.insert(divergences.end(), f.begin(), f.end());
+  std::sort(divergences.begin(), divergences.end(), [](const Divergence& a, const Divergence& b) { return a.seed < b.seed; });
+  for (const auto& d : divergences)
+    printf("seed %llu: %s diverges from visitor in %s\n", static_cast<unsigned long long>(d.seed), d.engine, d.field);
+
+  printf("programs: %zu\n", config->programs);
+  printf("instructions per program: %zu\n", config->count);
+  printf("threads: %zu\n", threads);
+  printf("jit: %s\n", jit ? "compared" : "unavailable");
+  printf("programs per second: %.0f\n", static_cast<double>(config->programs) / (seconds > 0 ? seconds : 1e-9));
+  printf("divergences: %zu\n", divergences.size());
+  return divergences.empty() ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+#ifndef generator_h_
+#define generator_h_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "word.h"
+#include "source.h"
+#include "instruction.h"
+
+// Deterministic random programs for differential testing of engines.
+// Generator has its own PRNG instead of standard distributions,
+// so a seed yields the same program on every host and standard library.
+
+/// <summary>
+/// SplitMix64 pseudo random generator.
+/// </summary>
+struct Random {
+  std::uint64_t state;
+
+  constexpr auto next() {
+    state += 0x9e3779b97f4a7c15;
+    auto z = state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+  }
+
+  /// <summary>
+  /// Number in [0, bound).
+  /// </summary>
+  constexpr auto below(const std::uint64_t bound) {
+    return next() % bound;
+  }
+
+  /// <summary>
+  /// Index chosen with probability proportional to its weight.
+  /// </summary>
+  template<std::size_t N>
+  constexpr auto pick(const std::array<unsigned, N>& weights) {
+    std::uint64_t total = 0;
+    for (const auto w : weights) total += w;
+    auto x = below(total > 0 ? total : 1);
+    for (std::size_t i = 0; i < N; i++) {
+      if (x < weights[i]) return i;
+      x -= weights[i];
+    }
+    return std::size_t {0};
+  }
+};
+
+/// <summary>
+/// Relative weights of Source alternatives.
+/// </summary>
+struct SourceWeights {
+  unsigned direct;
+  unsigned indirect;
+  unsigned immidiate;
+};
+
+struct GeneratorConfig {
+  SourceWeights operands{4, 2, 1};
+  /// <summary>
+  /// ImmidiateSource result raises an Exception, so it's rare by default.
+  /// </summary>
+  SourceWeights results{6, 3, 1};
+  unsigned unary{3};
+  unsigned binary{4};
+  unsigned jump{1};
+  /// <summary>
+  /// Count of registers addressed by DirectSource.
+  /// </summary>
+  int registers{16};
+  /// <summary>
+  /// Count of memory words addressed by IndirectSource.
+  /// </summary>
+  int memory{1024};
+  /// <summary>
+  /// Immidiate values are taken from [-immidiates, immidiates).
+  /// </summary>
+  int immidiates{256};
+};
+
+constexpr auto generate_source(Random& random, const SourceWeights& weights, const GeneratorConfig& config) -> Source {
+  switch (random.pick(std::array<unsigned, 3> {weights.direct, weights.indirect, weights.immidiate})) {
+    case 0: return DirectSource {static_cast<int>(random.below(static_cast<std::uint64_t>(config.registers)))};
+    case 1: return IndirectSource {static_cast<int>(random.below(static_cast<std::uint64_t>(config.memory)))};
+  }
+  return ImmidiateSource {static_cast<Value>(random.below(2 * static_cast<std::uint64_t>(config.immidiates))) - config.immidiates};
+}
+
+constexpr auto generate_instruction(Random& random, const GeneratorConfig& config) -> Instruction {
+  switch (random.pick(std::array<unsigned, 3> {config.unary, config.binary, config.jump})) {
+    case 0: {
+      const auto op1 = generate_source(random, config.operands, config);
+      const auto res = generate_source(random, config.results, config);
+      return UnaryInstruction {op1, res, static_cast<UnaryOperation>(random.below(unary_alu_operations))};
+    }
+    case 1: {
+      const auto op1 = generate_source(random, config.operands, config);
+      const auto op2 = generate_source(random, config.operands, config);
+      const auto res = generate_source(random, config.results, config);
+      return BinaryInstruction {op1, op2, res, static_cast<BinaryOperation>(random.below(alu_operations - unary_alu_operations))};
+    }
+  }
+  return JumpInstruction {generate_source(random, config.operands, config)};
+}
+
+/// <summary>
+/// Generate program of a length known at compile time, as engines compiling whole program expect.
+/// </summary>
+/// <param name="seed">
+/// Seed of program, the same seed and config always yield the same program.
+/// </param>
+template<std::size_t N>
+constexpr auto generate(const std::uint64_t seed, const GeneratorConfig& config = {}) {
+  Random random {seed};
+  std::array<Instruction, N> program;
+  for (auto& ins : program)
+    ins = generate_instruction(random, config);
+  return program;
+}
+
+inline auto generate(const std::uint64_t seed, const std::size_t length, const GeneratorConfig& config = {}) {
+  Random random {seed};
+  std::vector<Instruction> program;
+  program.reserve(length);
+  for (std::size_t i = 0; i < length; i++)
+    program.push_back(generate_instruction(random, config));
+  return program;
+}
+
+#endif
@@ -1,8 +1,11 @@
-#ifndef instricton_h_
+#ifndef instruction_h_
 #define instruction_h_
 
 #include <variant>
 
+#include "word.h"
+#include "alu.h"
+
 enum struct BinaryOperation {
   ADD,
   SUB
@@ -15,12 +18,24 @@ enum struct UnaryOperation {
   ZER
 };
 
+constexpr auto alu_operation(const UnaryOperation op) {
+  return static_cast<AluOperation>(op);
+}
+
+constexpr auto alu_operation(const BinaryOperation op) {
+  return static_cast<AluOperation>(unary_alu_operations + static_cast<std::size_t>(op));
+}
+
+static_assert(alu_operation(UnaryOperation::ZER) == AluOperation::ZER);
+static_assert(alu_operation(BinaryOperation::SUB) == AluOperation::SUB);
+
 struct UnaryInstruction {
   Source op1_addr;
   Source res_addr;
+  UnaryOperation op{UnaryOperation::MOV};
 
-  static constexpr auto calculate(const UnaryInstruction& ui, const int op1) {
-    return op1;
+  static constexpr auto calculate(const UnaryInstruction &ui, const Value op1) {
+    return alu(alu_operation(ui.op), op1, 0);
   }
 };
 
@@ -30,12 +45,8 @@ struct BinaryInstruction {
   Source res_addr;
   BinaryOperation op;
 
-  static constexpr auto calculate(const BinaryInstruction &bi, const int op1, const int op2) {
-    switch (bi.op) {
-      case BinaryOperation::ADD: return op1 + op2;
-      case BinaryOperation::SUB: return op1 - op2;
-    }
-    return 0;
+  static constexpr auto calculate(const BinaryInstruction &bi, const Value op1, const Value op2) {
+    return alu(alu_operation(bi.op), op1, op2);
   }
 
 };
@@ -43,7 +54,7 @@ struct BinaryInstruction {
 struct JumpInstruction {
   Source offset_addr;
 
-  static constexpr auto calculate(const JumpInstruction& ji, const int op1) {
+  static constexpr auto calculate(const JumpInstruction&, const Value op1) {
     return op1;
   }
 };
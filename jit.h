@@ -0,0 +1,230 @@
+#ifndef jit_h_
+#define jit_h_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+#include "state.h"
+#include "decoded.h"
+#include "block.h"
+
+// Emitted code operates on byte registers and memory, wider words are executed by block engine.
+#if defined(__x86_64__) && defined(__unix__) && CYCLE_SIMULATOR_WORD_BITS == 8
+#define JIT_X86_64 1
+#include <sys/mman.h>
+#endif
+
+/// <summary>
+/// Executable host code of a single program pass.
+/// Entry is called with state and count of passes to execute.
+/// </summary>
+struct JitCode {
+  typedef void (*Entry)(State*, std::size_t);
+
+  Entry entry{nullptr};
+  void* memory{nullptr};
+  std::size_t size{0};
+
+  JitCode() = default;
+  JitCode(const JitCode&) = delete;
+  JitCode& operator=(const JitCode&) = delete;
+  JitCode(JitCode&& other) noexcept :
+      entry{std::exchange(other.entry, nullptr)},
+      memory{std::exchange(other.memory, nullptr)},
+      size{std::exchange(other.size, 0)} {}
+  JitCode& operator=(JitCode&& other) noexcept {
+    std::swap(entry, other.entry);
+    std::swap(memory, other.memory);
+    std::swap(size, other.size);
+    return *this;
+  }
+  ~JitCode() {
+#ifdef JIT_X86_64
+    if (memory) munmap(memory, size);
+#endif
+  }
+
+  explicit operator bool() const { return entry != nullptr; }
+};
+
+#ifdef JIT_X86_64
+
+/// <summary>
+/// x86-64 System V code emitter.
+/// State pointer is kept in rdi, passes counter in rsi,
+/// operands are computed in eax and ecx.
+/// </summary>
+struct Emitter {
+  std::vector<std::uint8_t> code;
+
+  auto bytes(std::initializer_list<std::uint8_t> bs) {
+    code.insert(code.end(), bs);
+  }
+
+  auto imm32(const std::int32_t value) {
+    std::uint8_t raw[4];
+    std::memcpy(raw, &value, sizeof(raw));
+    code.insert(code.end(), raw, raw + sizeof(raw));
+  }
+
+  /// <summary>
+  /// Displacement of source cell from state pointer.
+  /// </summary>
+  static auto disp(const SourceKind kind, const int value) {
+    return static_cast<std::int32_t>(kind == SourceKind::DIRECT ? offsetof(State, regs) : offsetof(State, data)) + value;
+  }
+
+  // movzx reg, byte [rdi + disp32]
+  auto load_byte(const std::uint8_t modrm, const std::int32_t d) {
+    bytes({0x0f, 0xb6, modrm});
+    imm32(d);
+  }
+
+  auto load_op1(const MicroOp& op) {
+    if (op.op1_kind == SourceKind::IMMIDIATE) {
+      bytes({0xb8}); // mov eax, imm32
+      imm32(op.op1);
+    } else {
+      load_byte(0x87, disp(op.op1_kind, op.op1)); // eax
+    }
+  }
+
+  auto apply_op2(const MicroOp& op) {
+    // unary operations keep the low byte, so they are moves of byte words
+    const auto operation = alu_operation(op.op);
+    if (operation != AluOperation::ADD && operation != AluOperation::SUB) return;
+    const auto sub = operation == AluOperation::SUB;
+    if (op.op2_kind == SourceKind::IMMIDIATE) {
+      bytes({static_cast<std::uint8_t>(sub ? 0x2d : 0x05)}); // sub/add eax, imm32
+      imm32(op.op2);
+    } else {
+      load_byte(0x8f, disp(op.op2_kind, op.op2)); // ecx
+      bytes({static_cast<std::uint8_t>(sub ? 0x29 : 0x01), 0xc8}); // sub/add eax, ecx
+    }
+  }
+
+  auto store_res(const MicroOp& op) {
+    if (op.res_kind == SourceKind::IMMIDIATE) return;
+    bytes({0x88, 0x87}); // mov byte [rdi + disp32], al
+    imm32(disp(op.res_kind, op.res));
+  }
+
+  // add qword [rdi + disp32], imm32
+  auto add_counter(const std::size_t offset, const std::size_t value) {
+    if (value == 0) return;
+    bytes({0x48, 0x81, 0x87});
+    imm32(static_cast<std::int32_t>(offset));
+    imm32(static_cast<std::int32_t>(value));
+  }
+
+  auto add_block(const BlockSummary& block) {
+    add_counter(offsetof(State, clk), block.clk);
+    add_counter(offsetof(State, fetch1), block.fetch1);
+    add_counter(offsetof(State, fetch2), block.fetch2);
+    add_counter(offsetof(State, writeback), block.writeback);
+    add_counter(offsetof(State, exceptions), block.exceptions);
+  }
+};
+
+/// <summary>
+/// Translate program into host code.
+/// </summary>
+/// <returns>
+/// Compiled code or empty JitCode if program could not be compiled.
+/// </returns>
+template<std::size_t N>
+inline auto jit_compile(const BlockCache<N>& cache) {
+  Emitter e;
+  e.bytes({0x48, 0x85, 0xf6}); // test rsi, rsi
+  e.bytes({0x0f, 0x84});       // jz end
+  const auto jz = e.code.size();
+  e.imm32(0);
+  const auto loop = e.code.size();
+  for (std::size_t i = 0; i < N;) {
+    const auto block = cache.summarize(i);
+    if (block.clk > 0x7fffffff) return JitCode{};
+    e.add_block(block);
+    for (auto j = i; j < i + block.length; j++) {
+      e.load_op1(cache.program[j]);
+      e.apply_op2(cache.program[j]);
+      e.store_res(cache.program[j]);
+    }
+    i += block.length;
+  }
+  e.bytes({0x48, 0xff, 0xce}); // dec rsi
+  e.bytes({0x0f, 0x85});       // jnz loop
+  e.imm32(static_cast<std::int32_t>(loop) - static_cast<std::int32_t>(e.code.size() + 4));
+  const auto jz_target = static_cast<std::int32_t>(e.code.size() - (jz + 4));
+  std::memcpy(&e.code[jz], &jz_target, sizeof(jz_target));
+  e.bytes({0xc3}); // ret
+
+  JitCode code;
+  auto* memory = mmap(nullptr, e.code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) return code;
+  std::memcpy(memory, e.code.data(), e.code.size());
+  if (mprotect(memory, e.code.size(), PROT_READ | PROT_EXEC) != 0) {
+    munmap(memory, e.code.size());
+    return code;
+  }
+  code.memory = memory;
+  code.size = e.code.size();
+  code.entry = reinterpret_cast<JitCode::Entry>(memory);
+  return code;
+}
+
+#else
+
+template<std::size_t N>
+inline auto jit_compile(const BlockCache<N>&) {
+  return JitCode{};
+}
+
+#endif
+
+/// <summary>
+/// Program translated into host code with interpreter fallback.
+/// </summary>
+template<std::size_t N>
+struct JitProgram {
+  BlockCache<N> cache;
+  JitCode code;
+};
+
+template<std::size_t N>
+inline auto make_jit_program(const std::array<Instruction, N>& program) {
+  JitProgram<N> jit {make_block_cache(program), JitCode{}};
+  jit.code = jit_compile(jit.cache);
+  return jit;
+}
+
+/// <summary>
+/// Execute program with host code.
+/// Falls back to block engine when program could not be compiled.
+/// </summary>
+/// <param name="state">
+/// State to execute on.
+/// </param>
+/// <param name="jit">
+/// Compiled program.
+/// </param>
+/// <param name="count">
+/// Count of instructions to execute, program is repeated from the start when ends.
+/// </param>
+template<std::size_t N>
+inline auto run(State& state, JitProgram<N>& jit, const std::size_t count) {
+  if constexpr (N == 0) return;
+  if (!jit.code) {
+    run(state, jit.cache, count);
+    return;
+  }
+  jit.code.entry(&state, count / N);
+  for (std::size_t i = 0; i < count % N; i++)
+    execute(state, jit.cache.program[i]);
+}
+
+#endif
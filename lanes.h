@@ -0,0 +1,144 @@
+#ifndef lanes_h_
+#define lanes_h_
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <utility>
+
+#include "utilities.h"
+#include "state.h"
+#include "decoded.h"
+
+/// <summary>
+/// Structure of arrays state of many lanes executing the same program.
+/// Every register and memory cell is a row of lane values, so every micro-op
+/// is a row-wise load, calculation and store which compiler vectorizes
+/// for any host vector width.
+/// Cycle counting doesn't depend on values, so clk and metrics are shared by lanes.
+/// </summary>
+template<std::size_t Lanes>
+struct LaneState {
+  typedef std::array<State::word_type, Lanes> Row;
+
+  alignas(64) Row regs[16]{};
+  alignas(64) Row data[1024]{};
+
+  std::size_t clk{0};
+
+  std::size_t fetch1{0};
+  std::size_t fetch2{0};
+  std::size_t exec{0};
+  std::size_t writeback{0};
+  std::size_t exceptions{0};
+
+  /// <summary>
+  /// Copy registers and memory of a scalar state into lane.
+  /// </summary>
+  constexpr auto set_lane(const std::size_t lane, const State& state) {
+    for (std::size_t i = 0; i < 16; i++) regs[i][lane] = state.regs[i];
+    for (std::size_t i = 0; i < 1024; i++) data[i][lane] = state.data[i];
+  }
+
+  /// <summary>
+  /// Extract lane as a scalar state with shared metrics.
+  /// </summary>
+  constexpr auto get_lane(const std::size_t lane) const {
+    State state {};
+    for (std::size_t i = 0; i < 16; i++) state.regs[i] = regs[i][lane];
+    for (std::size_t i = 0; i < 1024; i++) state.data[i] = data[i][lane];
+    state.clk = clk;
+    state.fetch1 = fetch1;
+    state.fetch2 = fetch2;
+    state.exec = exec;
+    state.writeback = writeback;
+    state.exceptions = exceptions;
+    return state;
+  }
+};
+
+/// <summary>
+/// Read operand row of micro-op.
+/// Every AluOperation depends only on the low word or low byte of its operands,
+/// so immidiate row filled with words matches scalar calculation truncated on store.
+/// </summary>
+template<std::size_t Lanes>
+constexpr auto load(const LaneState<Lanes>& state, const SourceKind kind, const Value value) {
+  typename LaneState<Lanes>::Row row {};
+  switch (kind) {
+    case SourceKind::DIRECT: row = state.regs[value]; break;
+    case SourceKind::INDIRECT: row = state.data[value]; break;
+    case SourceKind::IMMIDIATE: row.fill(static_cast<State::word_type>(value)); break;
+  }
+  return row;
+}
+
+/// <summary>
+/// Calculate operation known at compile time lane by lane, so every operation is a vectorized loop.
+/// </summary>
+template<std::size_t Lanes, AluOperation Op>
+constexpr void calculate_row(typename LaneState<Lanes>::Row& value, const typename LaneState<Lanes>::Row& op2) {
+  for (std::size_t l = 0; l < Lanes; l++)
+    value[l] = static_cast<State::word_type>(alu<Op>(value[l], op2[l]));
+}
+
+template<std::size_t Lanes>
+using RowFunction = void (*)(typename LaneState<Lanes>::Row&, const typename LaneState<Lanes>::Row&);
+
+template<std::size_t Lanes, std::size_t... Is>
+constexpr auto make_row_table(std::index_sequence<Is...>) {
+  return std::array<RowFunction<Lanes>, sizeof...(Is)> {&calculate_row<Lanes, static_cast<AluOperation>(Is)>...};
+}
+
+/// <summary>
+/// Row-wise function of every AluOperation.
+/// </summary>
+template<std::size_t Lanes>
+inline constexpr auto row_table = make_row_table<Lanes>(std::make_index_sequence<alu_operations>{});
+
+/// <summary>
+/// Execute pre-decoded instruction on every lane.
+/// </summary>
+/// <param name="state">
+/// Lanes to execute on.
+/// </param>
+/// <param name="op">
+/// Micro-op to execute.
+/// </param>
+template<std::size_t Lanes>
+constexpr auto execute(LaneState<Lanes>& state, const MicroOp& op) {
+  state.clk += op.cost.clk;
+  state.fetch1 += op.cost.fetch1;
+  state.fetch2 += op.cost.fetch2;
+  state.writeback += op.cost.writeback;
+  state.exceptions += op.cost.exceptions;
+
+  auto value = load(state, op.op1_kind, op.op1);
+  if (op.op != OpCode::MOV)
+    row_table<Lanes>[static_cast<std::size_t>(alu_operation(op.op))](value, load(state, op.op2_kind, op.op2));
+  switch (op.res_kind) {
+    case SourceKind::DIRECT: state.regs[op.res] = value; break;
+    case SourceKind::INDIRECT: state.data[op.res] = value; break;
+    case SourceKind::IMMIDIATE: break;
+  }
+}
+
+/// <summary>
+/// Execute program on every lane.
+/// </summary>
+/// <param name="state">
+/// Lanes to execute on.
+/// </param>
+/// <param name="program">
+/// Pre-decoded program.
+/// </param>
+/// <param name="count">
+/// Count of instructions to execute, program is repeated from the start when ends.
+/// </param>
+template<std::size_t Lanes>
+constexpr auto run(LaneState<Lanes>& state, std::span<const MicroOp> program, const std::size_t count) {
+  repeat(program, count, [&state](const MicroOp& op) { execute(state, op); });
+}
+
+#endif
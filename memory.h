@@ -0,0 +1,140 @@
+#ifndef memory_h_
+#define memory_h_
+
+#include <array>
+#include <cstddef>
+#include <tuple>
+
+// Memory models account IndirectSource accesses of State.
+// Model access returns latency in cycles, State has already spent a single cycle
+// on every memory access, so latency of 1 keeps original timing.
+
+/// <summary>
+/// Flat memory: every access takes exactly one cycle.
+/// </summary>
+struct FlatMemory {
+  static constexpr std::size_t access(const std::size_t, const bool) { return 1; }
+};
+
+enum struct Replacement {
+  LRU,
+  PLRU
+};
+
+/// <summary>
+/// Set-associative cache level.
+/// Write-allocate, writes cost the same as reads.
+/// </summary>
+template<std::size_t LineSize, std::size_t Sets, std::size_t Ways, std::size_t Latency, Replacement Policy = Replacement::LRU>
+struct CacheLevel {
+  static_assert(LineSize > 0 && Sets > 0 && Ways > 0);
+  static_assert(Policy != Replacement::PLRU || (Ways & (Ways - 1)) == 0, "tree PLRU needs power of two ways");
+
+  static constexpr std::size_t latency = Latency;
+
+  struct Line {
+    bool valid;
+    std::size_t tag;
+    /// <summary>
+    /// Last access time for LRU.
+    /// </summary>
+    std::size_t stamp;
+  };
+
+  std::array<std::array<Line, Ways>, Sets> lines{};
+  /// <summary>
+  /// Tree PLRU bits of every set, bit points to less recently used half.
+  /// </summary>
+  std::array<std::array<bool, Ways>, Sets> tree{};
+  std::size_t time{0};
+
+  // Metrics
+  std::size_t hits{0};
+  std::size_t misses{0};
+
+  constexpr auto touch(const std::size_t set, const std::size_t way) {
+    if constexpr (Policy == Replacement::LRU) {
+      lines[set][way].stamp = ++time;
+    } else {
+      // walk from root to leaf, pointing every node away from accessed way
+      std::size_t node = 1;
+      for (std::size_t half = Ways / 2; half > 0; half /= 2) {
+        const auto right = (way & half) != 0;
+        tree[set][node] = !right;
+        node = node * 2 + right;
+      }
+    }
+  }
+
+  constexpr auto victim(const std::size_t set) {
+    for (std::size_t way = 0; way < Ways; way++)
+      if (!lines[set][way].valid) return way;
+    std::size_t way = 0;
+    if constexpr (Policy == Replacement::LRU) {
+      for (std::size_t w = 1; w < Ways; w++)
+        if (lines[set][w].stamp < lines[set][way].stamp) way = w;
+    } else {
+      std::size_t node = 1;
+      for (std::size_t half = Ways / 2; half > 0; half /= 2) {
+        const auto right = tree[set][node];
+        way |= right ? half : 0;
+        node = node * 2 + right;
+      }
+    }
+    return way;
+  }
+
+  /// <summary>
+  /// Access address, allocating line on miss.
+  /// </summary>
+  /// <returns>
+  /// True on hit.
+  /// </returns>
+  constexpr auto access(const std::size_t addr) {
+    const auto block = addr / LineSize;
+    const auto set = block % Sets;
+    const auto tag = block / Sets;
+    for (std::size_t way = 0; way < Ways; way++) {
+      if (lines[set][way].valid && lines[set][way].tag == tag) {
+        hits++;
+        touch(set, way);
+        return true;
+      }
+    }
+    misses++;
+    const auto way = victim(set);
+    lines[set][way] = Line {true, tag, 0};
+    touch(set, way);
+    return false;
+  }
+};
+
+/// <summary>
+/// Cache hierarchy probed from the first level.
+/// Every missed level allocates the line, access which misses every level
+/// additionally costs memory latency.
+/// </summary>
+template<std::size_t MemoryLatency, typename... Levels>
+struct CacheHierarchy {
+  static_assert(sizeof...(Levels) > 0);
+
+  std::tuple<Levels...> levels{};
+
+  constexpr auto access(const std::size_t addr, const bool) {
+    std::size_t latency = 0;
+    bool hit = false;
+    std::apply([&](auto&... level) {
+      ((hit || (latency += level.latency, hit = level.access(addr))), ...);
+    }, levels);
+    return hit ? latency : latency + MemoryLatency;
+  }
+};
+
+/// <summary>
+/// Example two level hierarchy: 256 B 2-way LRU L1 and 1 KiB 4-way PLRU L2.
+/// </summary>
+typedef CacheHierarchy<20,
+    CacheLevel<16, 8, 2, 1, Replacement::LRU>,
+    CacheLevel<32, 8, 4, 4, Replacement::PLRU>> TwoLevelCache;
+
+#endif
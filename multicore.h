@@ -0,0 +1,544 @@
+#ifndef multicore_h_
+#define multicore_h_
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "state.h"
+#include "decoded.h"
+
+// Multi-core CPU: every core owns registers and counters, data memory is shared.
+// Cores are simulated by host threads with one of two schedulers,
+// results of both don't depend on count of host threads.
+
+/// <summary>
+/// Synchronization of cores simulated by host threads.
+/// </summary>
+enum struct Scheduler {
+  /// <summary>
+  /// Cores run in quanta of simulated cycles separated by a barrier.
+  /// During a quantum a core sees shared memory and line states as they were at quantum start
+  /// plus its own writes, writes and line states are merged in a fixed order at the barrier.
+  /// Approximate: lines other cores take during a quantum aren't invalidated until the barrier,
+  /// so coherence cycles shrink as quantum grows. Two cores running the sample program
+  /// spend 77% of cycles on coherence with quantum 1, as with conservative scheduler, 63% with 10,
+  /// 8% with 100 and under 1% with 1000.
+  /// </summary>
+  QUANTUM,
+  /// <summary>
+  /// Conservative parallel discrete event simulation.
+  /// Cores run ahead independently over lines no other core's program touches
+  /// and wait only at an access to a shared line, until no other core could access shared line earlier.
+  /// Shared accesses are performed immediately in order of simulated time, ties are taken by lower core.
+  /// Coherence costs are exact, so it's the default.
+  /// </summary>
+  CONSERVATIVE
+};
+
+enum struct LineState : std::uint8_t {
+  INVALID,
+  SHARED,
+  EXCLUSIVE,
+  MODIFIED
+};
+
+/// <summary>
+/// Extra cycles of IndirectSource accesses on top of a regular memory access cycle.
+/// Access to a line held by core costs nothing extra.
+/// </summary>
+struct CoherenceCosts {
+  /// <summary>
+  /// Miss served by memory.
+  /// </summary>
+  std::size_t memory{8};
+  /// <summary>
+  /// Miss served by another core holding line exclusively.
+  /// </summary>
+  std::size_t transfer{12};
+  /// <summary>
+  /// Invalidation of copies held by other cores on write.
+  /// </summary>
+  std::size_t upgrade{4};
+};
+
+/// <summary>
+/// Simulated core executing its own pre-decoded program.
+/// Aligned to a cache line, so host threads simulating adjacent cores don't share lines.
+/// </summary>
+struct alignas(64) Core {
+  State::word_type regs[State::reg_count]{0};
+
+  /// <summary>
+  /// Program is repeated from the start when ends.
+  /// </summary>
+  std::span<const MicroOp> program;
+  /// <summary>
+  /// Count of instructions to execute.
+  /// </summary>
+  std::size_t count{0};
+  std::size_t executed{0};
+  std::size_t next{0};
+
+  /// <summary>
+  /// Writes of current quantum, visible only to this core until the barrier.
+  /// </summary>
+  State::word_type pending[State::mem_size]{0};
+  std::bitset<State::mem_size> written;
+  std::vector<int> writes;
+
+  /// <summary>
+  /// Line states as seen by this core during current quantum.
+  /// </summary>
+  std::vector<LineState> lines;
+  /// <summary>
+  /// Lines written during current quantum.
+  /// </summary>
+  std::vector<bool> dirty;
+
+  /// <summary>
+  /// Lookahead of conservative scheduler: static cycles from instruction to the next instruction
+  /// accessing a shared line, zero for instruction accessing a shared line itself.
+  /// </summary>
+  std::vector<std::size_t> ahead;
+  /// <summary>
+  /// Lower bound of simulated time of the next shared access published by core.
+  /// </summary>
+  alignas(64) std::atomic<std::size_t> bound{0};
+
+  // Cycle counter
+  std::size_t clk{0};
+
+  // Metrics
+  std::size_t fetch1{0};
+  std::size_t fetch2{0};
+  std::size_t writeback{0};
+  std::size_t exceptions{0};
+  std::size_t coherence{0};
+  std::size_t misses{0};
+  std::size_t upgrades{0};
+  /// <summary>
+  /// Times core waited for other cores before a shared access, depends on host timing.
+  /// </summary>
+  std::size_t waits{0};
+
+  auto finished() const { return executed >= count || program.empty(); }
+};
+
+struct MultiCore {
+  static constexpr std::size_t line_size = 16;
+  static constexpr std::size_t line_count = State::mem_size / line_size;
+
+  State::word_type data[State::mem_size]{0};
+  std::vector<Core> cores;
+  /// <summary>
+  /// Line states of every core at quantum start, states of a line are adjacent.
+  /// </summary>
+  std::vector<LineState> directory;
+  CoherenceCosts costs;
+
+  // Metrics
+  std::size_t quanta{0};
+
+  explicit MultiCore(const std::size_t count, const CoherenceCosts& costs = CoherenceCosts {})
+      : cores(count), directory(line_count * count, LineState::INVALID), costs{costs} {
+    for (auto& core : cores) {
+      core.lines.assign(line_count, LineState::INVALID);
+      core.dirty.assign(line_count, false);
+    }
+  }
+
+  /// <summary>
+  /// Whether other cores hold line at quantum start.
+  /// </summary>
+  /// <returns>
+  /// Pair of flags: line is held exclusively by another core, line is held by another core at all.
+  /// </returns>
+  auto holders(const std::size_t id, const std::size_t line) const {
+    bool owned = false;
+    bool held = false;
+    for (std::size_t other = 0; other < cores.size(); other++) {
+      const auto state = directory[line * cores.size() + other];
+      if (other == id || state == LineState::INVALID) continue;
+      owned |= state == LineState::EXCLUSIVE || state == LineState::MODIFIED;
+      held = true;
+    }
+    return std::pair {owned, held};
+  }
+
+  /// <summary>
+  /// Account IndirectSource access of core by MESI-like protocol.
+  /// Quantum scheduler changes line state seen by core only,
+  /// conservative scheduler changes line states of every core immediately.
+  /// </summary>
+  /// <returns>
+  /// Extra cycles of access.
+  /// </returns>
+  template<Scheduler S>
+  auto access(const std::size_t id, const std::size_t addr, const bool write) -> std::size_t {
+    if constexpr (S == Scheduler::CONSERVATIVE) return access_now(id, addr / line_size, write);
+    auto& core = cores[id];
+    const auto line = addr / line_size;
+    auto& state = core.lines[line];
+    std::size_t cycles = 0;
+    if (write) {
+      core.dirty[line] = true;
+      if (state == LineState::MODIFIED || state == LineState::EXCLUSIVE) {
+        state = LineState::MODIFIED;
+        return 0;
+      }
+      const auto [owned, held] = holders(id, line);
+      if (state == LineState::INVALID) {
+        core.misses++;
+        cycles += owned ? costs.transfer : costs.memory;
+      }
+      if (held) {
+        core.upgrades++;
+        cycles += costs.upgrade;
+      }
+      state = LineState::MODIFIED;
+    } else {
+      if (state != LineState::INVALID) return 0;
+      const auto [owned, held] = holders(id, line);
+      core.misses++;
+      cycles += owned ? costs.transfer : costs.memory;
+      state = held ? LineState::SHARED : LineState::EXCLUSIVE;
+    }
+    core.coherence += cycles;
+    return cycles;
+  }
+
+  /// <summary>
+  /// Account access of core to line shared by the directory.
+  /// </summary>
+  auto access_now(const std::size_t id, const std::size_t line, const bool write) -> std::size_t {
+    auto& core = cores[id];
+    const auto n = cores.size();
+    auto* states = &directory[line * n];
+    auto& state = states[id];
+    if (write ? state == LineState::MODIFIED || state == LineState::EXCLUSIVE : state != LineState::INVALID) {
+      if (write) state = LineState::MODIFIED;
+      return 0;
+    }
+    bool owned = false;
+    bool held = false;
+    for (std::size_t other = 0; other < n; other++) {
+      if (other == id || states[other] == LineState::INVALID) continue;
+      owned |= states[other] == LineState::EXCLUSIVE || states[other] == LineState::MODIFIED;
+      held = true;
+      states[other] = write ? LineState::INVALID : LineState::SHARED;
+    }
+    std::size_t cycles = 0;
+    if (state == LineState::INVALID) {
+      core.misses++;
+      cycles += owned ? costs.transfer : costs.memory;
+    }
+    if (write && held) {
+      core.upgrades++;
+      cycles += costs.upgrade;
+    }
+    state = write ? LineState::MODIFIED : held ? LineState::SHARED : LineState::EXCLUSIVE;
+    core.coherence += cycles;
+    return cycles;
+  }
+
+  template<Scheduler S>
+  auto load(const std::size_t id, const SourceKind kind, const Value value) {
+    auto& core = cores[id];
+    switch (kind) {
+      case SourceKind::DIRECT: return static_cast<Value>(core.regs[value]);
+      case SourceKind::INDIRECT: {
+        const auto addr = static_cast<std::size_t>(value);
+        core.clk += access<S>(id, addr, false);
+        if constexpr (S == Scheduler::CONSERVATIVE) return static_cast<Value>(data[addr]);
+        return static_cast<Value>(core.written[addr] ? core.pending[addr] : data[addr]);
+      }
+      case SourceKind::IMMIDIATE: return value;
+    }
+    return Value {0};
+  }
+
+  template<Scheduler S>
+  auto store(const std::size_t id, const SourceKind kind, const int addr, const Value value) {
+    auto& core = cores[id];
+    switch (kind) {
+      case SourceKind::DIRECT: core.regs[addr] = value; break;
+      case SourceKind::INDIRECT: {
+        const auto a = static_cast<std::size_t>(addr);
+        core.clk += access<S>(id, a, true);
+        if constexpr (S == Scheduler::CONSERVATIVE) {
+          data[a] = value;
+          break;
+        }
+        if (!core.written[a]) {
+          core.written.set(a);
+          core.writes.push_back(addr);
+        }
+        core.pending[a] = value;
+        break;
+      }
+      case SourceKind::IMMIDIATE: break;
+    }
+  }
+
+  /// <summary>
+  /// Execute pre-decoded instruction on core.
+  /// Counters are changed as State does, plus coherence cycles of IndirectSource accesses.
+  /// </summary>
+  template<Scheduler S>
+  auto execute(const std::size_t id, const MicroOp& op) {
+    auto& core = cores[id];
+    core.clk += op.cost.clk;
+    core.fetch1 += op.cost.fetch1;
+    core.fetch2 += op.cost.fetch2;
+    core.writeback += op.cost.writeback;
+    core.exceptions += op.cost.exceptions;
+    const auto op1 = load<S>(id, op.op1_kind, op.op1);
+    const auto op2 = load<S>(id, op.op2_kind, op.op2);
+    store<S>(id, op.res_kind, op.res, calculate(op.op, op1, op2));
+  }
+
+  /// <summary>
+  /// Execute core until its cycle counter reaches end of quantum or its instructions are executed.
+  /// </summary>
+  auto run_core(const std::size_t id, const std::size_t until) {
+    auto& core = cores[id];
+    while (!core.finished() && core.clk < until) {
+      execute<Scheduler::QUANTUM>(id, core.program[core.next]);
+      if (++core.next == core.program.size()) core.next = 0;
+      core.executed++;
+    }
+  }
+
+  /// <summary>
+  /// Merge quantum of every core: apply pending writes and resolve line states.
+  /// Cores are merged in order rotated every quantum, so no core always wins conflicts.
+  /// Line written by several cores is left modified by the last merged of them,
+  /// line read by several cores without writes is left shared.
+  /// </summary>
+  auto commit() noexcept {
+    const auto n = cores.size();
+    for (std::size_t i = 0; i < n; i++) {
+      auto& core = cores[(quanta + i) % n];
+      for (const auto addr : core.writes)
+        data[addr] = core.pending[addr];
+      core.writes.clear();
+      core.written.reset();
+    }
+    for (std::size_t line = 0; line < line_count; line++) {
+      auto* states = &directory[line * n];
+      std::size_t owner = n;
+      for (std::size_t i = 0; i < n; i++)
+        if (cores[(quanta + i) % n].dirty[line]) owner = (quanta + i) % n;
+      std::size_t held = 0;
+      for (std::size_t c = 0; c < n; c++) {
+        if (owner < n) states[c] = c == owner ? LineState::MODIFIED : LineState::INVALID;
+        else states[c] = cores[c].lines[line];
+        held += states[c] != LineState::INVALID;
+      }
+      for (std::size_t c = 0; c < n; c++) {
+        if (held > 1 && states[c] != LineState::INVALID) states[c] = LineState::SHARED;
+        cores[c].lines[line] = states[c];
+        cores[c].dirty[line] = false;
+      }
+    }
+    quanta++;
+  }
+
+  auto finished() const {
+    return std::all_of(cores.begin(), cores.end(), [](const Core& core) { return core.finished(); });
+  }
+
+  /// <summary>
+  /// Count of host threads simulating cores, hardware concurrency when zero.
+  /// </summary>
+  auto host_threads(std::size_t threads) const {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    return std::max<std::size_t>(1, std::min(threads, cores.size()));
+  }
+
+  /// <summary>
+  /// Execute every core on host threads with quantum scheduler.
+  /// </summary>
+  /// <param name="quantum">
+  /// Count of simulated cycles between barriers.
+  /// </param>
+  /// <param name="threads">
+  /// Count of host threads, hardware concurrency when zero.
+  /// Every thread simulates a contiguous range of cores.
+  /// </param>
+  auto run(std::size_t quantum, std::size_t threads) {
+    if (finished()) return;
+    quantum = std::max<std::size_t>(1, quantum);
+    threads = host_threads(threads);
+
+    std::size_t until = quantum;
+    bool done = false;
+    const auto complete = [this, quantum, &until, &done]() noexcept {
+      commit();
+      until += quantum;
+      done = finished();
+    };
+    std::barrier sync {static_cast<std::ptrdiff_t>(threads), complete};
+
+    const auto worker = [&](const std::size_t id) {
+      const auto first = id * cores.size() / threads;
+      const auto last = (id + 1) * cores.size() / threads;
+      while (!done) {
+        for (auto core = first; core < last; core++)
+          run_core(core, until);
+        sync.arrive_and_wait();
+      }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (std::size_t id = 1; id < threads; id++)
+      pool.emplace_back(worker, id);
+    worker(0);
+    for (auto& thread : pool)
+      thread.join();
+  }
+
+  /// <summary>
+  /// Find shared lines, touched by programs of more than one core, and compute lookahead of every core.
+  /// </summary>
+  auto prepare() {
+    constexpr auto never = std::numeric_limits<std::size_t>::max();
+    const auto n = cores.size();
+    std::vector<std::size_t> users(line_count, 0);
+    std::vector<std::size_t> last(line_count, n);
+    const auto touches = [](const MicroOp& op, auto&& line) {
+      if (op.op1_kind == SourceKind::INDIRECT) line(static_cast<std::size_t>(op.op1) / line_size);
+      if (op.op2_kind == SourceKind::INDIRECT) line(static_cast<std::size_t>(op.op2) / line_size);
+      if (op.res_kind == SourceKind::INDIRECT) line(static_cast<std::size_t>(op.res) / line_size);
+    };
+    for (std::size_t id = 0; id < n; id++) {
+      for (const auto& op : cores[id].program) {
+        touches(op, [&users, &last, id](const std::size_t line) {
+          if (last[line] != id) users[line]++;
+          last[line] = id;
+        });
+      }
+    }
+    for (auto& core : cores) {
+      const auto size = core.program.size();
+      const auto shared = [&](const std::size_t k) {
+        bool result = false;
+        touches(core.program[k], [&users, &result](const std::size_t line) { result |= users[line] > 1; });
+        return result;
+      };
+      core.ahead.assign(size, never);
+      std::size_t first = size;
+      for (std::size_t k = 0; k < size && first == size; k++)
+        if (shared(k)) first = k;
+      if (first == size) continue;
+      // walk backwards around repeated program from a shared instruction
+      core.ahead[first] = 0;
+      for (std::size_t j = 1; j < size; j++) {
+        const auto k = (first + size - j) % size;
+        core.ahead[k] = shared(k) ? 0 : core.program[k].cost.clk + core.ahead[(k + 1) % size];
+      }
+    }
+  }
+
+  auto publish(Core& core) {
+    constexpr auto never = std::numeric_limits<std::size_t>::max();
+    const auto ahead = core.finished() ? never : core.ahead[core.next];
+    core.bound.store(ahead == never ? never : core.clk + ahead, std::memory_order_release);
+  }
+
+  /// <summary>
+  /// Whether core could access a shared line at simulated time,
+  /// every other core accesses shared lines only later or loses a tie.
+  /// </summary>
+  auto safe(const std::size_t id, const std::size_t time) const {
+    for (std::size_t other = 0; other < cores.size(); other++) {
+      if (other == id) continue;
+      const auto bound = cores[other].bound.load(std::memory_order_acquire);
+      if (bound < time || (bound == time && other < id)) return false;
+    }
+    return true;
+  }
+
+  /// <summary>
+  /// Execute core until it's finished or waits for a shared access.
+  /// </summary>
+  /// <returns>
+  /// False if no instruction is executed.
+  /// </returns>
+  auto advance(const std::size_t id) {
+    auto& core = cores[id];
+    bool progress = false;
+    while (!core.finished()) {
+      if (core.ahead[core.next] == 0 && !safe(id, core.clk)) {
+        core.waits++;
+        break;
+      }
+      execute<Scheduler::CONSERVATIVE>(id, core.program[core.next]);
+      if (++core.next == core.program.size()) core.next = 0;
+      core.executed++;
+      publish(core);
+      progress = true;
+    }
+    return progress;
+  }
+
+  /// <summary>
+  /// Execute every core on host threads with conservative scheduler.
+  /// Lookahead of core is static cost of its instructions before the next shared access,
+  /// coherence cycles only add to it.
+  /// </summary>
+  /// <param name="threads">
+  /// Count of host threads, hardware concurrency when zero.
+  /// Every thread simulates a contiguous range of cores, advancing each of them in turn.
+  /// </param>
+  auto run_conservative(std::size_t threads) {
+    if (finished()) return;
+    threads = host_threads(threads);
+    prepare();
+    for (auto& core : cores)
+      publish(core);
+
+    const auto worker = [this, threads](const std::size_t id) {
+      const auto first = id * cores.size() / threads;
+      const auto last = (id + 1) * cores.size() / threads;
+      for (;;) {
+        bool progress = false;
+        bool done = true;
+        for (auto core = first; core < last; core++) {
+          progress |= advance(core);
+          done &= cores[core].finished();
+        }
+        if (done) return;
+        if (!progress) std::this_thread::yield();
+      }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (std::size_t id = 1; id < threads; id++)
+      pool.emplace_back(worker, id);
+    worker(0);
+    for (auto& thread : pool)
+      thread.join();
+  }
+
+  /// <summary>
+  /// Execute every core on host threads.
+  /// </summary>
+  auto run(const Scheduler scheduler, const std::size_t quantum, const std::size_t threads) {
+    if (scheduler == Scheduler::CONSERVATIVE) run_conservative(threads);
+    else run(quantum, threads);
+  }
+};
+
+#endif
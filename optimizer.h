@@ -0,0 +1,221 @@
+#ifndef optimizer_h_
+#define optimizer_h_
+
+#include <compare>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <span>
+#include <vector>
+
+#include "utilities.h"
+#include "source.h"
+#include "instruction.h"
+#include "state.h"
+#include "decoded.h"
+
+// Functional optimizer of repeated program.
+// Program executed by host loop never branches, so a single pass is a straight-line sequence
+// over statically known locations: DirectSource registers and IndirectSource addresses.
+// Optimized pass leaves registers and memory exactly as original pass does, metrics are not preserved.
+
+/// <summary>
+/// Register or memory cell.
+/// </summary>
+struct Location {
+  bool memory;
+  int index;
+
+  auto operator<=>(const Location&) const = default;
+};
+
+constexpr auto location_of(const Source& source) {
+  return std::visit(overloaded {
+    [](const DirectSource& s) { return std::optional<Location> {Location {false, s.reg}}; },
+    [](const IndirectSource& s) { return std::optional<Location> {Location {true, s.addr}}; },
+    [](const ImmidiateSource&) { return std::optional<Location> {}; }
+  }, source);
+}
+
+constexpr auto source_of(const Location& location) -> Source {
+  if (location.memory) return IndirectSource {location.index};
+  return DirectSource {location.index};
+}
+
+/// <summary>
+/// Lower instruction into unary or binary instruction with the same effect on registers and memory.
+/// JumpInstruction adds offset to regs[0], fetched from memory offset is stored as is.
+/// </summary>
+constexpr auto lower(const Instruction& ins) -> Instruction {
+  if (const auto* jump = std::get_if<JumpInstruction>(&ins)) {
+    if (std::holds_alternative<IndirectSource>(jump->offset_addr))
+      return UnaryInstruction {jump->offset_addr, DirectSource {0}};
+    return BinaryInstruction {jump->offset_addr, DirectSource {0}, DirectSource {0}, BinaryOperation::ADD};
+  }
+  return ins;
+}
+
+constexpr auto result_of(const Instruction& ins) {
+  return std::visit(overloaded {
+    [](const UnaryInstruction& i) { return i.res_addr; },
+    [](const BinaryInstruction& i) { return i.res_addr; },
+    [](const JumpInstruction&) -> Source { return DirectSource {0}; }
+  }, ins);
+}
+
+/// <summary>
+/// Propagate constants and copies forward, fold operations over immidiates
+/// and drop stores which don't change anything.
+/// </summary>
+template<typename Word>
+inline auto propagate(const std::vector<Instruction>& program) {
+  std::vector<Instruction> result;
+  // locations holding a known value
+  std::map<Location, Value> known;
+  // locations holding the current value of another location
+  std::map<Location, Location> copies;
+
+  const auto rewrite = [&known, &copies](const Source& source) -> Source {
+    const auto location = location_of(source);
+    if (!location) return source;
+    if (const auto k = known.find(*location); k != known.end()) return ImmidiateSource {k->second};
+    if (const auto c = copies.find(*location); c != copies.end()) return source_of(c->second);
+    return source;
+  };
+  const auto truncate = [](const Value value) { return static_cast<Value>(static_cast<Word>(value)); };
+
+  for (const auto& original : program) {
+    auto ins = std::visit(overloaded {
+      [&rewrite, &truncate](const UnaryInstruction& i) -> Instruction {
+        const UnaryInstruction u {rewrite(i.op1_addr), i.res_addr, i.op};
+        const auto* op1 = std::get_if<ImmidiateSource>(&u.op1_addr);
+        if (op1 && u.op != UnaryOperation::MOV) return UnaryInstruction {ImmidiateSource {truncate(UnaryInstruction::calculate(u, op1->value))}, u.res_addr};
+        return u;
+      },
+      [&rewrite, &truncate](const BinaryInstruction& i) -> Instruction {
+        const BinaryInstruction b {rewrite(i.op1_addr), rewrite(i.op2_addr), i.res_addr, i.op};
+        const auto* op1 = std::get_if<ImmidiateSource>(&b.op1_addr);
+        const auto* op2 = std::get_if<ImmidiateSource>(&b.op2_addr);
+        if (op1 && op2) return UnaryInstruction {ImmidiateSource {truncate(BinaryInstruction::calculate(b, op1->value, op2->value))}, b.res_addr};
+        if (op2 && op2->value == 0) return UnaryInstruction {b.op1_addr, b.res_addr};
+        if (op1 && op1->value == 0 && b.op == BinaryOperation::ADD) return UnaryInstruction {b.op2_addr, b.res_addr};
+        return b;
+      },
+      [](const JumpInstruction& i) -> Instruction { return i; }
+    }, lower(original));
+
+    // result stored into immidiate is discarded
+    const auto res = location_of(result_of(ins));
+    if (!res) continue;
+
+    // only moves are tracked, other unary operations just overwrite result
+    const auto* unary = std::get_if<UnaryInstruction>(&ins);
+    if (unary && unary->op != UnaryOperation::MOV) unary = nullptr;
+    const auto* value = unary ? std::get_if<ImmidiateSource>(&unary->op1_addr) : nullptr;
+    const auto from = unary ? location_of(unary->op1_addr) : std::optional<Location> {};
+    if (from == res) continue;
+    if (value) {
+      const auto k = known.find(*res);
+      if (k != known.end() && k->second == truncate(value->value)) continue;
+    }
+    if (from) {
+      const auto c = copies.find(*res);
+      if (c != copies.end() && c->second == *from) continue;
+    }
+
+    known.erase(*res);
+    copies.erase(*res);
+    std::erase_if(copies, [&res](const auto& c) { return c.second == *res; });
+    if (value) known[*res] = truncate(value->value);
+    else if (from) copies[*res] = *from;
+    result.push_back(ins);
+  }
+  return result;
+}
+
+/// <summary>
+/// Drop stores which are overwritten later in the pass before anything reads them.
+/// Every location is read by the next pass, so the last store of a location is always kept.
+/// </summary>
+inline auto eliminate_dead_stores(const std::vector<Instruction>& program) {
+  std::vector<Instruction> result;
+  std::set<Location> overwritten;
+  for (auto i = program.rbegin(); i != program.rend(); i++) {
+    const auto res = location_of(result_of(*i));
+    if (res && overwritten.contains(*res)) continue;
+    if (res) overwritten.insert(*res);
+    const auto read = [&overwritten](const Source& source) {
+      if (const auto location = location_of(source)) overwritten.erase(*location);
+    };
+    std::visit(overloaded {
+      [&read](const UnaryInstruction& x) { read(x.op1_addr); },
+      [&read](const BinaryInstruction& x) { read(x.op1_addr); read(x.op2_addr); },
+      [&read](const JumpInstruction& x) { read(x.offset_addr); read(DirectSource {0}); }
+    }, *i);
+    result.push_back(*i);
+  }
+  return std::vector<Instruction> {result.rbegin(), result.rend()};
+}
+
+/// <summary>
+/// Optimize a single pass of repeated program for functional execution.
+/// </summary>
+/// <param name="program">
+/// Program to optimize.
+/// </param>
+/// <returns>
+/// Unary and binary instructions changing registers and memory exactly as a pass of program does.
+/// </returns>
+template<typename Word = State::word_type>
+inline auto optimize(std::span<const Instruction> program) {
+  std::vector<Instruction> result {program.begin(), program.end()};
+  for (auto size = result.size() + 1; result.size() < size;) {
+    size = result.size();
+    result = eliminate_dead_stores(propagate<Word>(result));
+  }
+  return result;
+}
+
+/// <summary>
+/// Program prepared for functional execution.
+/// </summary>
+struct FunctionalProgram {
+  /// <summary>
+  /// Optimized full pass.
+  /// </summary>
+  std::vector<MicroOp> pass;
+  /// <summary>
+  /// Original program for the last partial pass.
+  /// </summary>
+  std::vector<MicroOp> original;
+};
+
+inline auto make_functional_program(std::span<const Instruction> program) {
+  return FunctionalProgram {decode(optimize(program)), decode(program)};
+}
+
+/// <summary>
+/// Execute program functionally: only registers and memory are changed.
+/// Full passes execute optimized program, the last partial pass executes original one.
+/// </summary>
+/// <param name="state">
+/// State to execute on.
+/// </param>
+/// <param name="program">
+/// Program to execute.
+/// </param>
+/// <param name="count">
+/// Count of instructions to execute, program is repeated from the start when ends.
+/// </param>
+inline auto run(State& state, const FunctionalProgram& program, const std::size_t count) {
+  if (program.original.empty()) return;
+  for (std::size_t i = 0; i < count / program.original.size(); i++) {
+    for (const auto& op : program.pass)
+      transform(state, op);
+  }
+  for (std::size_t i = 0; i < count % program.original.size(); i++)
+    transform(state, program.original[i]);
+}
+
+#endif
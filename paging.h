@@ -0,0 +1,106 @@
+#ifndef paging_h_
+#define paging_h_
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+// Sparse data storage of State: address space is split into 4 KiB pages allocated on first touch,
+// so memory use follows the working set of program rather than its address range.
+
+/// <summary>
+/// Demand paged words indexed like a flat array.
+/// Untouched words read as zero. Recently used pages are kept by a direct mapped software TLB,
+/// so repeated accesses of a page skip page table lookup.
+/// </summary>
+template<typename Word, std::size_t TlbEntries = 64>
+struct PagedMemory {
+  static_assert(TlbEntries > 0 && (TlbEntries & (TlbEntries - 1)) == 0, "TLB entries should be a power of two");
+
+  static constexpr std::size_t page_bytes = 4096;
+  static constexpr std::size_t page_words = page_bytes / sizeof(Word);
+
+  typedef std::array<Word, page_words> Page;
+
+  struct TlbEntry {
+    std::size_t page;
+    /// <summary>
+    /// Words of page, entry is empty when null.
+    /// </summary>
+    Word* words;
+  };
+
+  std::array<TlbEntry, TlbEntries> tlb{};
+  std::unordered_map<std::size_t, std::unique_ptr<Page>> pages;
+
+  // Metrics
+  std::size_t tlb_hits{0};
+  std::size_t tlb_misses{0};
+
+  PagedMemory() = default;
+
+  PagedMemory(const PagedMemory& other) : tlb_hits{other.tlb_hits}, tlb_misses{other.tlb_misses} {
+    for (const auto& [page, words] : other.pages)
+      pages.emplace(page, std::make_unique<Page>(*words));
+  }
+
+  PagedMemory(PagedMemory&& other) noexcept
+      : tlb{std::exchange(other.tlb, {})}, pages{std::move(other.pages)},
+        tlb_hits{other.tlb_hits}, tlb_misses{other.tlb_misses} {}
+
+  auto operator=(const PagedMemory& other) -> PagedMemory& {
+    if (this != &other) *this = PagedMemory {other};
+    return *this;
+  }
+
+  auto operator=(PagedMemory&& other) noexcept -> PagedMemory& {
+    tlb = std::exchange(other.tlb, {});
+    pages = std::move(other.pages);
+    tlb_hits = other.tlb_hits;
+    tlb_misses = other.tlb_misses;
+    return *this;
+  }
+
+  /// <summary>
+  /// Access word, allocating its page on first touch.
+  /// </summary>
+  auto operator[](const std::size_t addr) -> Word& {
+    const auto page = addr / page_words;
+    auto& entry = tlb[page & (TlbEntries - 1)];
+    if (entry.words && entry.page == page) [[likely]] {
+      tlb_hits++;
+      return entry.words[addr % page_words];
+    }
+    tlb_misses++;
+    entry = TlbEntry {page, map(page)};
+    return entry.words[addr % page_words];
+  }
+
+  /// <summary>
+  /// Read word without allocation.
+  /// </summary>
+  auto operator[](const std::size_t addr) const -> Word {
+    const auto page = pages.find(addr / page_words);
+    return page != pages.end() ? (*page->second)[addr % page_words] : Word {0};
+  }
+
+  /// <summary>
+  /// Page table walk of a TLB miss.
+  /// </summary>
+  auto map(const std::size_t page) -> Word* {
+    auto& words = pages[page];
+    if (!words) words = std::make_unique<Page>();
+    return words->data();
+  }
+
+  /// <summary>
+  /// Count of allocated pages.
+  /// </summary>
+  auto resident() const {
+    return pages.size();
+  }
+};
+
+#endif
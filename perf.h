@@ -0,0 +1,115 @@
+#ifndef perf_h_
+#define perf_h_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+#if defined(__linux__)
+#define PERF_COUNTERS 1
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// <summary>
+/// Host hardware events counted around simulation loop.
+/// </summary>
+enum struct HostEvent : std::size_t {
+  CYCLES,
+  INSTRUCTIONS,
+  BRANCH_MISSES,
+  L1D_MISSES
+};
+
+constexpr std::size_t host_events = 4;
+
+constexpr const char* host_event_names[host_events] {
+  "host cycles",
+  "host instructions",
+  "host branch misses",
+  "host L1d misses"
+};
+
+/// <summary>
+/// Counted host events, empty when event isn't supported by host or not permitted.
+/// </summary>
+typedef std::array<std::optional<std::uint64_t>, host_events> HostCounters;
+
+/// <summary>
+/// User space host counters read by perf_event_open.
+/// Every event is opened separately, so unsupported event doesn't disable others,
+/// counts are scaled when kernel multiplexes counters.
+/// Not available on other platforms, every counter is empty there.
+/// </summary>
+struct PerfCounters {
+  std::array<int, host_events> fds{-1, -1, -1, -1};
+
+#ifdef PERF_COUNTERS
+  PerfCounters() {
+    constexpr std::array<std::pair<std::uint32_t, std::uint64_t>, host_events> events {{
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+      {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16}
+    }};
+    for (std::size_t i = 0; i < host_events; i++) {
+      perf_event_attr attr {};
+      attr.size = sizeof(attr);
+      attr.type = events[i].first;
+      attr.config = events[i].second;
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fds[i] = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+  }
+
+  ~PerfCounters() {
+    for (const auto fd : fds)
+      if (fd >= 0) ::close(fd);
+  }
+#else
+  PerfCounters() = default;
+#endif
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  auto start() {
+#ifdef PERF_COUNTERS
+    for (const auto fd : fds) {
+      if (fd < 0) continue;
+      ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+
+  auto stop() {
+#ifdef PERF_COUNTERS
+    for (const auto fd : fds)
+      if (fd >= 0) ::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+  }
+
+  auto read() const {
+    HostCounters counters{};
+#ifdef PERF_COUNTERS
+    for (std::size_t i = 0; i < host_events; i++) {
+      // value, time enabled, time running
+      std::uint64_t values[3] {};
+      if (fds[i] < 0 || ::read(fds[i], values, sizeof(values)) != sizeof(values) || values[2] == 0) continue;
+      counters[i] = values[2] == values[1] ? values[0]
+          : static_cast<std::uint64_t>(static_cast<double>(values[0]) * static_cast<double>(values[1]) / static_cast<double>(values[2]));
+    }
+#endif
+    return counters;
+  }
+};
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef pipeline_h_
+#define pipeline_h_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "state.h"
+#include "decoded.h"
+
+/// <summary>
+/// Resolution of read after write hazard between in-flight instructions.
+/// STALL waits until writer stores result.
+/// FORWARD takes result from writer which is already executed.
+/// </summary>
+enum struct HazardPolicy {
+  STALL,
+  FORWARD
+};
+
+enum struct Stage : std::size_t {
+  OP1,
+  OP2,
+  EX,
+  WB
+};
+
+/// <summary>
+/// Pipeline latch, holds instruction waiting for a stage.
+/// </summary>
+struct Latch {
+  bool valid{false};
+  const MicroOp* op{nullptr};
+  Value op1{0};
+  Value op2{0};
+  Value value{0};
+  /// <summary>
+  /// Extra cycles left for memory access in this stage.
+  /// </summary>
+  int busy{0};
+};
+
+/// <summary>
+/// Overlapped in-order pipeline: fetch/decode, Op1Fetch, Op2Fetch, Execution and Writeback
+/// are separate stages, so up to five instructions are in flight.
+/// IndirectSource access takes an extra cycle in stage which accesses memory,
+/// hazards are checked on the last cycle of operand fetch.
+/// Registers and memory of State are changed as by sequential execution.
+/// clk counts pipelined cycles, fetch1 and fetch2 count memory operand fetches,
+/// exec counts executed instructions, writeback counts memory stores
+/// and exceptions count results into ImmidiateSource.
+/// </summary>
+struct Pipeline {
+  HazardPolicy policy{HazardPolicy::STALL};
+  /// <summary>
+  /// Input latches of Op1Fetch, Op2Fetch, Execution and Writeback stages.
+  /// </summary>
+  std::array<Latch, 4> latches{};
+
+  // Metrics
+  std::size_t fetched{0};
+  std::size_t retired{0};
+  std::size_t stalls{0};
+  std::size_t memory_stalls{0};
+  std::size_t forwards{0};
+
+  constexpr auto latch(const Stage stage) -> Latch& {
+    return latches[static_cast<std::size_t>(stage)];
+  }
+
+  constexpr auto empty() const {
+    for (const auto& l : latches)
+      if (l.valid) return false;
+    return true;
+  }
+
+  /// <summary>
+  /// Read operand for instruction in stage.
+  /// Looks for the youngest older in-flight instruction writing the same location.
+  /// </summary>
+  /// <param name="state">
+  /// State to read from.
+  /// </param>
+  /// <param name="stage">
+  /// Stage of reading instruction.
+  /// </param>
+  /// <param name="kind">
+  /// Addressing mode of operand.
+  /// </param>
+  /// <param name="value">
+  /// Operand value.
+  /// </param>
+  /// <param name="out">
+  /// Read value.
+  /// </param>
+  /// <returns>
+  /// False if instruction should stall on this cycle.
+  /// </returns>
+  constexpr auto read(const State& state, const Stage stage, const SourceKind kind, const Value value, Value& out) {
+    if (kind != SourceKind::IMMIDIATE) {
+      for (auto s = static_cast<std::size_t>(stage) + 1; s < latches.size(); s++) {
+        const auto& older = latches[s];
+        if (!older.valid || older.op->res_kind != kind || older.op->res != value) continue;
+        if (s != static_cast<std::size_t>(Stage::WB) || policy == HazardPolicy::STALL) return false;
+        forwards++;
+        out = static_cast<Value>(static_cast<State::word_type>(older.value));
+        return true;
+      }
+    }
+    out = load(state, kind, value);
+    return true;
+  }
+
+  /// <summary>
+  /// Move instruction to the next stage if it's free.
+  /// </summary>
+  constexpr auto advance(const Stage from, const int busy) {
+    auto& next = latches[static_cast<std::size_t>(from) + 1];
+    next = latch(from);
+    next.busy = busy;
+    latch(from).valid = false;
+  }
+
+  constexpr auto wait(Latch& l) {
+    if (l.busy == 0) return false;
+    l.busy--;
+    memory_stalls++;
+    return true;
+  }
+
+  /// <summary>
+  /// Execute a single pipeline cycle.
+  /// Stages are processed from Writeback to fetch, so every instruction moves at most one stage.
+  /// </summary>
+  /// <param name="state">
+  /// State to execute on.
+  /// </param>
+  /// <param name="program">
+  /// Pre-decoded program.
+  /// </param>
+  /// <param name="count">
+  /// Count of instructions to fetch, program is repeated from the start when ends.
+  /// </param>
+  constexpr auto step(State& state, std::span<const MicroOp> program, const std::size_t count) {
+    state.clk++;
+
+    if (auto& wb = latch(Stage::WB); wb.valid && !wait(wb)) {
+      store(state, wb.op->res_kind, wb.op->res, wb.value);
+      state.writeback += wb.op->res_kind == SourceKind::INDIRECT;
+      state.exceptions += wb.op->res_kind == SourceKind::IMMIDIATE;
+      wb.valid = false;
+      retired++;
+    }
+
+    if (auto& ex = latch(Stage::EX); ex.valid && !latch(Stage::WB).valid) {
+      ex.value = calculate(ex.op->op, ex.op1, ex.op2);
+      state.exec++;
+      advance(Stage::EX, ex.op->res_kind == SourceKind::INDIRECT);
+    }
+
+    if (auto& op2 = latch(Stage::OP2); op2.valid && !latch(Stage::EX).valid) {
+      if (wait(op2)) {
+      } else if (!read(state, Stage::OP2, op2.op->op2_kind, op2.op->op2, op2.op2)) {
+        stalls++;
+      } else {
+        state.fetch2 += op2.op->op2_kind == SourceKind::INDIRECT;
+        advance(Stage::OP2, 0);
+      }
+    }
+
+    if (auto& op1 = latch(Stage::OP1); op1.valid && !latch(Stage::OP2).valid) {
+      if (wait(op1)) {
+      } else if (!read(state, Stage::OP1, op1.op->op1_kind, op1.op->op1, op1.op1)) {
+        stalls++;
+      } else {
+        state.fetch1 += op1.op->op1_kind == SourceKind::INDIRECT;
+        advance(Stage::OP1, op1.op->op2_kind == SourceKind::INDIRECT);
+      }
+    }
+
+    if (auto& op1 = latch(Stage::OP1); !op1.valid && fetched < count && !program.empty()) {
+      op1 = Latch {true, &program[fetched % program.size()], 0, 0, 0, 0};
+      op1.busy = op1.op->op1_kind == SourceKind::INDIRECT;
+      fetched++;
+    }
+  }
+};
+
+/// <summary>
+/// Execute program on pipeline until every instruction is retired.
+/// </summary>
+/// <param name="state">
+/// State to execute on.
+/// </param>
+/// <param name="pipeline">
+/// Pipeline to execute on.
+/// </param>
+/// <param name="program">
+/// Pre-decoded program.
+/// </param>
+/// <param name="count">
+/// Count of instructions to execute, program is repeated from the start when ends.
+/// </param>
+constexpr auto run(State& state, Pipeline& pipeline, std::span<const MicroOp> program, const std::size_t count) {
+  if (program.empty()) return;
+  do {
+    pipeline.step(state, program, count);
+  } while (pipeline.fetched < count || !pipeline.empty());
+}
+
+#endif
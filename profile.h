@@ -0,0 +1,137 @@
+#ifndef profile_h_
+#define profile_h_
+
+#include <algorithm>
+#include <cstddef>
+#include <numeric>
+#include <span>
+#include <vector>
+
+#include "source.h"
+#include "instruction.h"
+#include "state.h"
+#include "decoded.h"
+
+// Per-instruction profile of a repeated program, indexed by position of instruction in program.
+// Engines don't know about profiling: profiled run is a separate host loop,
+// so runs without profile execute exactly the same code as before.
+
+/// <summary>
+/// Counters of a single instruction of program.
+/// </summary>
+struct InstructionProfile {
+  std::size_t executed;
+  std::size_t cycles;
+  /// <summary>
+  /// Cycles spent on IndirectSource fetches and writebacks into IndirectSource, memory model latency included.
+  /// </summary>
+  std::size_t memory_stalls;
+};
+
+/// <summary>
+/// Result of instruction is stored into memory, JumpInstruction stores into regs[0].
+/// </summary>
+constexpr auto stores_to_memory(const Instruction& ins) {
+  return std::visit(overloaded {
+    [](const UnaryInstruction& i) { return std::holds_alternative<IndirectSource>(i.res_addr); },
+    [](const BinaryInstruction& i) { return std::holds_alternative<IndirectSource>(i.res_addr); },
+    [](const JumpInstruction&) { return false; }
+  }, ins);
+}
+
+/// <summary>
+/// Flat array of counters of every instruction of program.
+/// </summary>
+typedef std::vector<InstructionProfile> Profile;
+
+/// <summary>
+/// Execute instruction with visitor engine and account it.
+/// Every cycle of instruction but fetch+decode, exception and register writeback ones is spent on memory:
+/// Writeback following an Op2Fetch or a jump offset fetch might store into a register.
+/// </summary>
+template<typename S>
+constexpr auto execute_profiled(S& state, const Instruction& ins, InstructionProfile& counters) {
+  const auto clk = state.clk;
+  const auto exceptions = state.exceptions;
+  const auto writeback = state.writeback;
+  state.execute(ins);
+  const auto cycles = state.clk - clk;
+  const auto register_writeback = stores_to_memory(ins) ? 0 : state.writeback - writeback;
+  counters.executed++;
+  counters.cycles += cycles;
+  counters.memory_stalls += cycles - 1 - (state.exceptions - exceptions) - register_writeback;
+}
+
+/// <summary>
+/// Execute program with visitor engine, accounting every instruction.
+/// </summary>
+/// <param name="state">
+/// State to execute on.
+/// </param>
+/// <param name="program">
+/// Program to execute.
+/// </param>
+/// <param name="count">
+/// Count of instructions to execute, program is repeated from the start when ends.
+/// </param>
+/// <param name="profile">
+/// Profile of program, resized to program when doesn't match it.
+/// </param>
+template<typename S>
+inline auto run_profiled(S& state, std::span<const Instruction> program, const std::size_t count, Profile& profile) {
+  if (program.empty()) return;
+  profile.resize(program.size());
+  for (std::size_t pass = 0; pass < count / program.size(); pass++) {
+    for (std::size_t i = 0; i < program.size(); i++)
+      execute_profiled(state, program[i], profile[i]);
+  }
+  for (std::size_t i = 0; i < count % program.size(); i++)
+    execute_profiled(state, program[i], profile[i]);
+}
+
+/// <summary>
+/// Profile of pre-decoded program derived from micro-op costs without execution.
+/// Flat memory timing doesn't depend on values, so it matches profiled visitor engine run.
+/// </summary>
+/// <param name="program">
+/// Pre-decoded program.
+/// </param>
+/// <param name="count">
+/// Count of instructions executed, program is repeated from the start when ends.
+/// </param>
+inline auto profile_of(std::span<const MicroOp> program, const std::size_t count) {
+  Profile profile(program.size());
+  for (std::size_t i = 0; i < program.size(); i++) {
+    const auto& cost = program[i].cost;
+    const auto executed = count / program.size() + (i < count % program.size() ? 1 : 0);
+    const auto register_writeback = program[i].res_kind == SourceKind::INDIRECT ? 0u : cost.writeback;
+    profile[i] = InstructionProfile {executed, executed * cost.clk, executed * (cost.clk - 1u - cost.exceptions - register_writeback)};
+  }
+  return profile;
+}
+
+/// <summary>
+/// Indices of the hottest instructions by cycles spent.
+/// </summary>
+/// <param name="profile">
+/// Profile of program.
+/// </param>
+/// <param name="n">
+/// Maximum count of instructions to report.
+/// </param>
+/// <returns>
+/// Up to n instruction indices, most cycles first, ties in program order.
+/// </returns>
+inline auto hottest(const Profile& profile, const std::size_t n) {
+  std::vector<std::size_t> indices(profile.size());
+  std::iota(indices.begin(), indices.end(), std::size_t {0});
+  const auto top = std::min(n, indices.size());
+  std::partial_sort(indices.begin(), indices.begin() + static_cast<std::ptrdiff_t>(top), indices.end(),
+                    [&profile](const std::size_t a, const std::size_t b) {
+                      return profile[a].cycles != profile[b].cycles ? profile[a].cycles > profile[b].cycles : a < b;
+                    });
+  indices.resize(top);
+  return indices;
+}
+
+#endif
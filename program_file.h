@@ -0,0 +1,300 @@
+#ifndef program_file_h_
+#define program_file_h_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PROGRAM_FILE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "utilities.h"
+#include "source.h"
+#include "instruction.h"
+#include "state.h"
+#include "decoded.h"
+
+// Binary program file: ProgramHeader followed by ProgramHeader::count of EncodedInstruction records.
+// Records are mapped as they are, so fields are in byte order of host program is written on
+// and files aren't portable between hosts of different endianness.
+// Registers and memory are stored as words of the width program is written with.
+
+constexpr std::uint32_t program_file_version = 2;
+
+struct ProgramHeader {
+  char magic[4];
+  std::uint32_t version;
+  std::uint64_t count;
+  std::uint32_t word_bits;
+  std::uint32_t reserved;
+  MachineWord regs[16];
+  MachineWord data[1024];
+};
+
+enum struct InstructionType : std::uint8_t {
+  UNARY,
+  BINARY,
+  JUMP
+};
+
+/// <summary>
+/// Fixed width instruction record.
+/// Addressing modes are packed by two bits: first operand, second operand, result.
+/// Unused operands are encoded as zero DirectSource.
+/// Immidiate values are limited to 32 bits.
+/// </summary>
+struct EncodedInstruction {
+  InstructionType type;
+  std::uint8_t op;
+  std::uint8_t kinds;
+  std::uint8_t reserved;
+  std::int32_t op1;
+  std::int32_t op2;
+  std::int32_t res;
+};
+
+static_assert(sizeof(ProgramHeader) % alignof(EncodedInstruction) == 0);
+static_assert(sizeof(EncodedInstruction) == 16);
+static_assert(std::is_trivially_copyable_v<EncodedInstruction>);
+
+constexpr auto encode(const Instruction& ins) {
+  const auto kinds = [](const Source& op1, const Source& op2, const Source& res) {
+    return static_cast<std::uint8_t>(op1.index() | op2.index() << 2 | res.index() << 4);
+  };
+  const auto field = [](const Source& source) {
+    const auto value = value_of(source);
+    if (value < INT32_MIN || value > INT32_MAX) throw std::runtime_error{"immidiate value doesn't fit program file"};
+    return static_cast<std::int32_t>(value);
+  };
+  return std::visit(overloaded {
+    [&kinds, &field](const UnaryInstruction& i) {
+      return EncodedInstruction {InstructionType::UNARY, static_cast<std::uint8_t>(i.op), kinds(i.op1_addr, DirectSource{0}, i.res_addr), 0,
+                                 field(i.op1_addr), 0, field(i.res_addr)};
+    },
+    [&kinds, &field](const BinaryInstruction& i) {
+      return EncodedInstruction {InstructionType::BINARY, static_cast<std::uint8_t>(i.op), kinds(i.op1_addr, i.op2_addr, i.res_addr), 0,
+                                 field(i.op1_addr), field(i.op2_addr), field(i.res_addr)};
+    },
+    [&kinds, &field](const JumpInstruction& i) {
+      return EncodedInstruction {InstructionType::JUMP, 0, kinds(i.offset_addr, DirectSource{0}, DirectSource{0}), 0,
+                                 field(i.offset_addr), 0, 0};
+    }
+  }, ins);
+}
+
+/// <summary>
+/// Decode instruction record straight into a micro-op, without building an Instruction.
+/// Register indices and memory addresses are validated against State, as file could be malformed.
+/// </summary>
+/// <param name="ins">
+/// Instruction record.
+/// </param>
+/// <returns>
+/// MicroOp equal to decode() of original Instruction.
+/// </returns>
+constexpr auto decode(const EncodedInstruction& ins) {
+  const auto kind = [&ins](const int shift) {
+    const auto k = ins.kinds >> shift & 0x3;
+    if (k > static_cast<int>(SourceKind::IMMIDIATE)) throw std::runtime_error{"malformed addressing mode"};
+    return static_cast<SourceKind>(k);
+  };
+  const auto in_range = [](const SourceKind kind, const Value value) {
+    if (kind == SourceKind::DIRECT && (value < 0 || static_cast<std::size_t>(value) >= State::reg_count))
+      throw std::runtime_error{"register index out of range"};
+    if (kind == SourceKind::INDIRECT && (value < 0 || static_cast<std::size_t>(value) >= State::mem_size))
+      throw std::runtime_error{"memory address out of range"};
+  };
+  MicroOp op {};
+  switch (ins.type) {
+    case InstructionType::UNARY:
+      if (ins.op > static_cast<std::uint8_t>(UnaryOperation::ZER)) throw std::runtime_error{"malformed unary operation"};
+      op = MicroOp {op_code(static_cast<UnaryOperation>(ins.op)), kind(0), SourceKind::IMMIDIATE, kind(4), ins.op1, 0, ins.res, Cost {}};
+      break;
+    case InstructionType::BINARY:
+      if (ins.op > static_cast<std::uint8_t>(BinaryOperation::SUB)) throw std::runtime_error{"malformed binary operation"};
+      op = MicroOp {op_code(static_cast<BinaryOperation>(ins.op)),
+                    kind(0), kind(2), kind(4), ins.op1, ins.op2, ins.res, Cost {}};
+      break;
+    case InstructionType::JUMP:
+      op = MicroOp {OpCode::JMP, kind(0), kind(0) == SourceKind::INDIRECT ? SourceKind::IMMIDIATE : SourceKind::DIRECT,
+                    SourceKind::DIRECT, ins.op1, 0, 0, Cost {}};
+      break;
+    default:
+      throw std::runtime_error{"malformed instruction type"};
+  }
+  in_range(op.op1_kind, op.op1);
+  in_range(op.op2_kind, op.op2);
+  in_range(op.res_kind, op.res);
+  op.cost = cost_of(op.op, op.op1_kind, op.op2_kind, op.res_kind);
+  return op;
+}
+
+/// <summary>
+/// Write program file.
+/// </summary>
+/// <param name="path">
+/// Path to program file.
+/// </param>
+/// <param name="program">
+/// Program to encode.
+/// </param>
+/// <param name="state">
+/// State with initial registers and memory.
+/// </param>
+inline auto write_program(const std::string& path, std::span<const Instruction> program, const State& state) {
+  ProgramHeader header {{'C', 'S', 'I', 'M'}, program_file_version, program.size(), word_bits, 0, {}, {}};
+  std::memcpy(header.regs, state.regs, sizeof(header.regs));
+  std::memcpy(header.data, state.data, sizeof(header.data));
+
+  auto* file = std::fopen(path.c_str(), "wb");
+  if (!file) throw std::runtime_error{"unable to open " + path};
+  auto ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+  for (const auto& ins : program) {
+    const auto record = encode(ins);
+    ok = ok && std::fwrite(&record, sizeof(record), 1, file) == 1;
+  }
+  ok = std::fclose(file) == 0 && ok;
+  if (!ok) throw std::runtime_error{"unable to write " + path};
+}
+
+/// <summary>
+/// Read-only program file mapped into memory.
+/// Instructions are decoded on execution, so opening takes no time regardless of program size.
+/// </summary>
+struct ProgramFile {
+  const std::uint8_t* bytes{nullptr};
+  std::size_t size{0};
+  /// <summary>
+  /// Fallback storage when memory mapping isn't available.
+  /// </summary>
+  std::vector<std::uint8_t> buffer;
+
+  explicit ProgramFile(const std::string& path) {
+#ifdef PROGRAM_FILE_MMAP
+    const auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error{"unable to open " + path};
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw std::runtime_error{"unable to stat " + path};
+    }
+    size = static_cast<std::size_t>(st.st_size);
+    auto* memory = size > 0 ? ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (memory == MAP_FAILED) throw std::runtime_error{"unable to map " + path};
+    ::madvise(memory, size, MADV_SEQUENTIAL);
+    bytes = static_cast<const std::uint8_t*>(memory);
+#else
+    auto* file = std::fopen(path.c_str(), "rb");
+    if (!file) throw std::runtime_error{"unable to open " + path};
+    std::uint8_t chunk[1 << 16];
+    for (std::size_t n; (n = std::fread(chunk, 1, sizeof(chunk), file)) > 0;)
+      buffer.insert(buffer.end(), chunk, chunk + n);
+    std::fclose(file);
+    bytes = buffer.data();
+    size = buffer.size();
+#endif
+    // fields preceding registers are the same for every width, so they are checked first
+    if (size < offsetof(ProgramHeader, regs) || std::memcmp(header().magic, "CSIM", 4) != 0) {
+      release();
+      throw std::runtime_error{"not a program file " + path};
+    }
+    if (header().version != program_file_version) {
+      release();
+      throw std::runtime_error{"unsupported program file version " + path};
+    }
+    if (header().word_bits != word_bits) {
+      release();
+      throw std::runtime_error{"program file word width doesn't match simulator " + path};
+    }
+    if (size < sizeof(ProgramHeader)) {
+      release();
+      throw std::runtime_error{"truncated program file " + path};
+    }
+    if ((size - sizeof(ProgramHeader)) / sizeof(EncodedInstruction) < header().count) {
+      release();
+      throw std::runtime_error{"truncated program file " + path};
+    }
+  }
+
+  ProgramFile(const ProgramFile&) = delete;
+  ProgramFile& operator=(const ProgramFile&) = delete;
+
+  ~ProgramFile() { release(); }
+
+  auto release() -> void {
+#ifdef PROGRAM_FILE_MMAP
+    if (bytes) ::munmap(const_cast<std::uint8_t*>(bytes), size);
+#endif
+    bytes = nullptr;
+  }
+
+  auto header() const -> const ProgramHeader& {
+    return *reinterpret_cast<const ProgramHeader*>(bytes);
+  }
+
+  auto instructions() const {
+    return std::span<const EncodedInstruction> {
+        reinterpret_cast<const EncodedInstruction*>(bytes + sizeof(ProgramHeader)),
+        static_cast<std::size_t>(header().count)};
+  }
+
+  /// <summary>
+  /// Copy initial registers and memory into state.
+  /// </summary>
+  auto load(State& state) const {
+    std::memcpy(state.regs, header().regs, sizeof(state.regs));
+    std::memcpy(state.data, header().data, sizeof(state.data));
+  }
+};
+
+/// <summary>
+/// Execute program file with pre-decoded engine, decoding instructions in chunks.
+/// Program which fits into a single chunk is decoded once.
+/// </summary>
+/// <param name="state">
+/// State to execute on.
+/// </param>
+/// <param name="file">
+/// Program file.
+/// </param>
+/// <param name="count">
+/// Count of instructions to execute, program is repeated from the start when ends.
+/// </param>
+inline auto run(State& state, const ProgramFile& file, const std::size_t count) {
+  constexpr std::size_t chunk = 4096;
+  const auto instructions = file.instructions();
+  if (instructions.empty()) return;
+  std::vector<MicroOp> ops(std::min(chunk, instructions.size()));
+  const auto decode_chunk = [&](const std::size_t offset, const std::size_t n) {
+    for (std::size_t i = 0; i < n; i++)
+      ops[i] = decode(instructions[offset + i]);
+    return std::span<const MicroOp> {ops.data(), n};
+  };
+
+  if (instructions.size() <= chunk) {
+    run(state, decode_chunk(0, instructions.size()), count);
+    return;
+  }
+  for (auto remaining = count; remaining > 0;) {
+    for (std::size_t offset = 0; offset < instructions.size() && remaining > 0; offset += chunk) {
+      const auto n = std::min({chunk, instructions.size() - offset, remaining});
+      run(state, decode_chunk(offset, n), n);
+      remaining -= n;
+    }
+  }
+}
+
+#endif
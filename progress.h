@@ -0,0 +1,130 @@
+#ifndef progress_h_
+#define progress_h_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+#include "state.h"
+
+/// <summary>
+/// Counters published by simulation thread for reporter thread.
+/// Kept on its own cache line, so reporter reads don't disturb state.
+/// </summary>
+struct alignas(64) Progress {
+  std::atomic<std::size_t> instructions{0};
+  std::atomic<std::size_t> clk{0};
+  std::atomic<std::size_t> fetch1{0};
+  std::atomic<std::size_t> fetch2{0};
+  std::atomic<std::size_t> writeback{0};
+  std::atomic<std::size_t> exceptions{0};
+
+  auto publish(const State& state, const std::size_t executed) {
+    clk.store(state.clk, std::memory_order_relaxed);
+    fetch1.store(state.fetch1, std::memory_order_relaxed);
+    fetch2.store(state.fetch2, std::memory_order_relaxed);
+    writeback.store(state.writeback, std::memory_order_relaxed);
+    exceptions.store(state.exceptions, std::memory_order_relaxed);
+    instructions.store(executed, std::memory_order_release);
+  }
+};
+
+/// <summary>
+/// Execute instructions by chunks and publish progress after every chunk.
+/// Chunk should be a multiple of program size, so every chunk starts from the program start.
+/// </summary>
+/// <param name="state">
+/// State to execute on.
+/// </param>
+/// <param name="progress">
+/// Progress to publish, instructions are executed by a single call when empty.
+/// </param>
+/// <param name="count">
+/// Count of instructions to execute.
+/// </param>
+/// <param name="chunk">
+/// Count of instructions between publications.
+/// </param>
+/// <param name="run">
+/// Executes given count of instructions on state.
+/// </param>
+template<typename Run>
+inline auto run_with_progress(State& state, Progress* progress, const std::size_t count, const std::size_t chunk, Run&& run) {
+  if (!progress || chunk == 0) {
+    run(count);
+    return;
+  }
+  for (std::size_t done = 0; done < count;) {
+    const auto n = std::min(chunk, count - done);
+    run(n);
+    done += n;
+    progress->publish(state, done);
+  }
+}
+
+/// <summary>
+/// Background thread printing instantaneous and average simulated frequency,
+/// instructions per second and share of cycles spent by every stage.
+/// </summary>
+struct ProgressReporter {
+  Progress& progress;
+  std::chrono::milliseconds interval;
+  std::FILE* out;
+  bool stopping{false};
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  std::thread thread;
+
+  ProgressReporter(Progress& progress, const std::chrono::milliseconds interval, std::FILE* out = stderr)
+      : progress{progress}, interval{interval}, out{out} {
+    thread = std::thread {[this] { report(); }};
+  }
+
+  ProgressReporter(const ProgressReporter&) = delete;
+  ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+  ~ProgressReporter() {
+    {
+      std::lock_guard lock {mutex};
+      stopping = true;
+    }
+    wakeup.notify_one();
+    thread.join();
+  }
+
+  auto report() -> void {
+    const auto start = std::chrono::steady_clock::now();
+    auto last = start;
+    std::size_t last_clk = 0;
+    bool printed = false;
+    std::unique_lock lock {mutex};
+    while (!wakeup.wait_for(lock, interval, [this] { return stopping; })) {
+      const auto now = std::chrono::steady_clock::now();
+      const auto instructions = progress.instructions.load(std::memory_order_acquire);
+      const auto clk = progress.clk.load(std::memory_order_relaxed);
+      const auto share = [clk](const std::atomic<std::size_t>& counter) {
+        return clk > 0 ? 100.0 * static_cast<double>(counter.load(std::memory_order_relaxed)) / static_cast<double>(clk) : 0.0;
+      };
+      const auto us = [](const auto delta) {
+        return std::max<double>(1, static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(delta).count()));
+      };
+      fprintf(out, "approx. %.0f khz, avg. %.0f khz, %.0f kips, fetch1 %.1f%% fetch2 %.1f%% writeback %.1f%% exceptions %.1f%%\r",
+              static_cast<double>(clk - last_clk) * 1000 / us(now - last),
+              static_cast<double>(clk) * 1000 / us(now - start),
+              static_cast<double>(instructions) * 1000 / us(now - start),
+              share(progress.fetch1), share(progress.fetch2), share(progress.writeback), share(progress.exceptions));
+      fflush(out);
+      printed = true;
+      last = now;
+      last_clk = clk;
+    }
+    if (printed) fprintf(out, "\n");
+  }
+};
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef sampling_h_
+#define sampling_h_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <span>
+
+#include "source.h"
+#include "instruction.h"
+#include "state.h"
+#include "decoded.h"
+
+/// <summary>
+/// Systematic sampling: every period starts with functional fast-forward
+/// and ends with a detailed window of the same length.
+/// </summary>
+struct SamplingConfig {
+  /// <summary>
+  /// Count of instructions between starts of detailed windows.
+  /// </summary>
+  std::size_t period{100000};
+  /// <summary>
+  /// Count of instructions executed in detail on every period.
+  /// </summary>
+  std::size_t window{1000};
+};
+
+/// <summary>
+/// Metrics extrapolated from detailed windows to the whole run.
+/// </summary>
+struct SampleEstimate {
+  std::size_t samples{0};
+  /// <summary>
+  /// Count of instructions executed in detail.
+  /// </summary>
+  std::size_t detailed{0};
+  std::size_t clk{0};
+  std::size_t fetch1{0};
+  std::size_t fetch2{0};
+  std::size_t writeback{0};
+  std::size_t exceptions{0};
+  /// <summary>
+  /// Mean cycles per instruction of detailed windows.
+  /// </summary>
+  double cpi{0};
+  /// <summary>
+  /// Half-width of 95% confidence interval of cpi.
+  /// </summary>
+  double cpi_error{0};
+};
+
+/// <summary>
+/// Execute program sampled: registers and memory are changed by every instruction,
+/// metrics of state are changed by detailed windows only.
+/// </summary>
+/// <param name="state">
+/// State to execute on.
+/// </param>
+/// <param name="program">
+/// Program to execute in detailed windows.
+/// </param>
+/// <param name="ops">
+/// Pre-decoded program to fast-forward.
+/// </param>
+/// <param name="count">
+/// Count of instructions to execute, program is repeated from the start when ends.
+/// </param>
+/// <param name="config">
+/// Period and window of sampling.
+/// </param>
+/// <returns>
+/// Metrics estimate of whole run, empty and nothing is executed when period or window is zero.
+/// </returns>
+inline auto run_sampled(State& state, std::span<const Instruction> program, std::span<const MicroOp> ops,
+                        const std::size_t count, const SamplingConfig& config) {
+  SampleEstimate estimate;
+  if (program.empty() || config.window == 0 || config.period == 0) return estimate;
+  const auto window = std::min(config.window, config.period);
+  const auto skip = config.period - window;
+  const auto clk = state.clk, fetch1 = state.fetch1, fetch2 = state.fetch2;
+  const auto writeback = state.writeback, exceptions = state.exceptions;
+
+  // running mean and variance of windows CPI
+  double mean = 0, m2 = 0;
+  std::size_t pc = 0;
+  const auto advance = [&pc, &program] { pc = pc + 1 < program.size() ? pc + 1 : 0; };
+  for (auto remaining = count; remaining > 0;) {
+    for (auto n = std::min(skip, remaining); n > 0; n--, remaining--) {
+      transform(state, ops[pc]);
+      advance();
+    }
+    if (remaining < window) {
+      for (; remaining > 0; remaining--) {
+        transform(state, ops[pc]);
+        advance();
+      }
+      break;
+    }
+    const auto begin = state.clk;
+    for (auto n = window; n > 0; n--, remaining--) {
+      state.execute(program[pc]);
+      advance();
+    }
+    const auto cpi = static_cast<double>(state.clk - begin) / static_cast<double>(window);
+    estimate.samples++;
+    const auto delta = cpi - mean;
+    mean += delta / static_cast<double>(estimate.samples);
+    m2 += delta * (cpi - mean);
+  }
+
+  estimate.detailed = estimate.samples * window;
+  if (estimate.detailed == 0) return estimate;
+  const auto scale = [&estimate, count](const std::size_t value) {
+    return static_cast<std::size_t>(std::llround(static_cast<double>(value) * static_cast<double>(count) / static_cast<double>(estimate.detailed)));
+  };
+  estimate.clk = scale(state.clk - clk);
+  estimate.fetch1 = scale(state.fetch1 - fetch1);
+  estimate.fetch2 = scale(state.fetch2 - fetch2);
+  estimate.writeback = scale(state.writeback - writeback);
+  estimate.exceptions = scale(state.exceptions - exceptions);
+  estimate.cpi = mean;
+  if (estimate.samples > 1)
+    estimate.cpi_error = 1.96 * std::sqrt(m2 / static_cast<double>(estimate.samples - 1) / static_cast<double>(estimate.samples));
+  return estimate;
+}
+
+#endif
@@ -1,443 +1,616 @@
-#include <optional>
-#include <stdexcept>
+#include <algorithm>
 #include <array>
 #include <chrono>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
-#include "utilities.h"
-#include "source.h"
-#include "instruction.h"
-#include "event.h"
+#include "state.h"
+#include "evaluate.h"
+#include "decoded.h"
+#include "threaded.h"
+#include "block.h"
+#include "jit.h"
+#include "batch.h"
+#include "lanes.h"
+#include "pipeline.h"
+#include "program_file.h"
+#include "snapshot.h"
+#include "sampling.h"
+#include "perf.h"
+#include "progress.h"
+#include "optimizer.h"
+#include "multicore.h"
+#include "word.h"
+#include "alu.h"
+#include "paging.h"
+#include "profile.h"
 
-struct State {
+enum struct Engine {
+  VISITOR,
+  DECODED,
+  THREADED,
+  BLOCK,
+  JIT,
+  /// <summary>
+  /// Optimized program changing registers and memory only, metrics stay zero.
+  /// </summary>
+  FUNCTIONAL
+};
 
-  // Memory
-  
+struct Options {
+  Engine engine{Engine::VISITOR};
   /// <summary>
-  /// Registers are available in CPU and doesn't take an extra cycle to access.
+  /// Count of instructions to execute, whole program file
+  /// or a long run of built-in program when not set.
   /// </summary>
-  std::uint8_t regs[16]{0};
+  std::optional<std::size_t> count;
   /// <summary>
-  /// RAM access is takes an extra cycle to access.
+  /// Count of independent jobs to simulate in batch mode, zero for a single run.
   /// </summary>
-  std::uint8_t data[1024]{0};
-
-  // Cycle counter
-  std::size_t clk{0};
-
-  // Metrics
-  std::size_t fetch1{0};
-  std::size_t fetch2{0};
-  std::size_t exec{0};
-  std::size_t writeback{0};
-  std::size_t exceptions{0};
-
+  std::size_t jobs{0};
   /// <summary>
-  /// Unwrap source into a raw value.
+  /// Count of batch worker threads, hardware concurrency when zero.
   /// </summary>
-  /// <param name="source">
-  /// Source to unwrap.
-  /// DirectSource will read from register.
-  /// IndirectSource will read from memory.
-  /// ImmidiateSource will just return a immidiate value.
-  /// </param>
-  /// <returns>
-  /// Unwarpped value.
-  /// </returns>
-  constexpr auto read_value_from_source(const Source& source) {
-    return std::visit(overloaded {
-       [this](const DirectSource& s) {
-         return static_cast<int>(regs[s.reg]);
-       },
-       [this](const IndirectSource& s) {
-         return static_cast<int>(data[s.addr]);
-       },
-       [](const ImmidiateSource& s) {
-         return s.value;
-       }
-    }, source);
-  }
-
+  std::size_t threads{0};
   /// <summary>
-  /// Unwrap source and write value to referenced pointer.
+  /// Count of lanes executing program in lane-parallel mode, zero for a single run.
   /// </summary>
-  /// <param name="source">
-  /// Source to unwrap and write value.
-  /// DirectSource will write to registers.
-  /// IndirectSource will write to memory.
-  /// ImmidiateSource will throw an exception because writing to immidiate is quite a strange thing to do.
-  /// </param>
-  /// <param name="value">
-  /// Value to write.
-  /// </param>
-  /// <returns>
-  /// Nothing.
-  /// </returns>
-  constexpr auto put_value_to_source(const Source& source, int value) {
-     std::visit(overloaded {
-       [this, value](const DirectSource& s) {
-         regs[s.reg] = value;
-       },
-       [this, value](const IndirectSource& s) {
-         data[s.addr] = value;
-       },
-       [](const ImmidiateSource&) {
-         throw std::logic_error{"putting into immidiate source is prohibited by logic" };
-       }
-      }, source);
-  }
-
+  std::size_t lanes{0};
   /// <summary>
-  /// Execute writeback on current cycle or return
-  /// event for a next cycle.
-  /// Writeback might be executed on this cycle when result is stored 
-  /// in registers (DirectSoruce). 
-  /// Writeback to memoryr (IndirectSource) will take an extra cycle
-  /// to execute, so will return a Writeback event.
+  /// Execute on overlapped pipeline model with hazard policy instead of engine.
   /// </summary>
-  /// <param name="wr">
-  /// Writeback event to perform on this or next cycle.
-  /// </param>
-  /// <param name="res_addr">
-  /// Source where result is stored.
-  /// </param>
-  /// <returns>
-  /// Optional ExecutionEvent to execute on next cycle.
-  /// If writeback is executed on this cycle, will return an empty optional.
-  /// </returns>
-  constexpr auto get_writeback(const Writeback& wr, const Source& res_addr) {
-    return std::visit(overloaded  {
-        [this, &wr](const DirectSource& s) -> std::optional<ExecutionEvent> {
-             put_value_to_source(s, wr.res);
-             return std::optional<ExecutionEvent>{};
-        },
-        [&wr](const IndirectSource&) -> std::optional<ExecutionEvent> {
-             return wr;
-        },
-        [](const ImmidiateSource&) -> std::optional<ExecutionEvent> {
-             return Exception{"ImmidiateSource is prohibited as result source"};
-        }
-    }, res_addr);
-  }
-
+  std::optional<HazardPolicy> pipeline;
   /// <summary>
-  /// Calculate value on this cycle and return writeback event for next cycle.
+  /// Program file to execute instead of built-in program.
   /// </summary>
-  /// <param name="i">
-  /// Instruction to execute.
-  /// </param>
-  /// <param name="op1">
-  /// First operand value.
-  /// </param>
-  /// <param name="op2">
-  /// Second operand value.
-  /// </param>
-  /// <returns>
-  /// Writeback event to execute on next cycle 
-  /// with calculated value.
-  /// </returns>
-  constexpr auto calculate_value(const Instruction&i, const int op1, const int op2) {
-    const auto value = std::visit(overloaded {
-        [op1](const UnaryInstruction& x) {
-          return UnaryInstruction::calculate(x, op1);
-        },
-        [op1, op2](const JumpInstruction& x) {
-          return JumpInstruction::calculate(x, op1 + op2);
-        },
-        [op1, op2](const BinaryInstruction& x) {
-          return BinaryInstruction::calculate(x, op1, op2);
-        }
-    }, i);
-    return Writeback {i, value};
-  }
-
+  std::string program;
   /// <summary>
-  /// Fetch second operand for an instruction on this cycle
-  /// if it's available. Return next cycle event to execute.
-  /// Might return Writeback event when opearand is available on this cycle
-  /// and could be calculated on this cycle and result should be stored on next event.
-  /// Might return empty optional when writeback when operand is available on this cycle
-  /// and could be calculated on this cycle and result could be stored on this cycle.
-  /// Might return Op2Fetch event when operand is not available on this cycle and will take an 
-  /// extra cycle to fetch.
+  /// Program file to write built-in program into.
   /// </summary>
-  /// <param name="e">
-  /// Op2Fetch event.
-  /// </param>
-  /// <returns>
-  /// Optional next cycle event.
-  /// Op2Fetch, Writeback or empty optional
-  /// </returns>
-  constexpr auto get_fetch2(const Op2Fetch& e) {
-    const Source src = std::visit(overloaded {
-      [](const BinaryInstruction& i) -> Source {
-        return i.op2_addr;
-      },
-      [](const UnaryInstruction&) -> Source {
-          return DirectSource{0};
-      },
-      [](const JumpInstruction&) -> Source {
-          return DirectSource{0};
-      }
-    }, e.ins);
-    const Source res = std::visit(overloaded {
-        [](const BinaryInstruction& i) -> Source {
-          return i.res_addr;
-        },
-        [](const UnaryInstruction& i) -> Source {
-          return i.res_addr;
-        },
-        [](const JumpInstruction&) -> Source {
-          return DirectSource{0};
-        }
-    }, e.ins);
-    return std::visit(overloaded {
-      [this, &e, &res](const DirectSource& s) -> std::optional<ExecutionEvent> {
-        const auto wr = calculate_value(e.ins, e.op1, regs[s.reg]);
-        return get_writeback(wr, res);
-      },
-      [this, &e, &res](const ImmidiateSource& s) -> std::optional<ExecutionEvent> {
-        const auto wr = calculate_value(e.ins, e.op1, s.value);
-        return get_writeback(wr, res);
-      },
-      [e](const IndirectSource&) -> std::optional<ExecutionEvent> {
-        return e;
-      }
-    }, src);
-  }
-
+  std::string save;
   /// <summary>
-  /// Fetch first operand on this cycle if it's available.
-  /// Might return Op1Fetch when first operand is not available.
-  /// Might return Op2Fetch if first operand is available on this cycle
-  /// but second operand is not.
-  /// Might return Writeback if both operands are available on this cycle
-  /// but result couldn't be stored on this cycle.
-  /// Might return empty optional if both operands are available on this cycle
-  /// and result could be stored on this cycle.
+  /// Trace file of visitor engine cycles.
   /// </summary>
-  /// <param name="ins">
-  /// Instruction to fetch first operand.
-  /// </param>
-  /// <returns>
-  /// Optional event for next cycle.
-  /// Op1Fetch, Op2Fetch, Writeback or empty optional.
-  /// </returns>
-  constexpr auto get_fetch1(const Instruction& ins) {
-    const auto src = std::visit(overloaded {
-      [](const BinaryInstruction& i) {
-        return i.op1_addr;
-      },
-      [](const UnaryInstruction& i) {
-        return i.op1_addr;
-      },
-      [](const JumpInstruction& i) {
-        return i.offset_addr;
-      }
-    }, ins);
-    return std::visit(overloaded {
-       [this, &ins](const DirectSource& s) -> std::optional<ExecutionEvent> {
-           return get_fetch2(Op2Fetch{ins, regs[s.reg]});
-       },
-       [this, &ins](const ImmidiateSource& s) -> std::optional<ExecutionEvent> {
-           return get_fetch2(Op2Fetch{ins, s.value});
-       },
-       [&ins](const IndirectSource&) -> std::optional<ExecutionEvent> {
-         return Op1Fetch{ins};
-       }
-    }, src);
-  }
-
+  std::string trace;
   /// <summary>
-  /// Execute Op1Fetch on this cycle and return next cycle event.
+  /// Execute looping program by program counter instead of host loop.
   /// </summary>
-  /// <param name="event">
-  /// Op1Fetch event.
-  /// </param>
-  /// <returns>
-  /// Optional next cycle event for this instruction.
-  /// </returns>
-  constexpr auto handle_event(const Op1Fetch& event) {
-    fetch1++;
-    return std::visit(overloaded {
-      [this](const BinaryInstruction& i) -> std::optional<ExecutionEvent> {
-          return get_fetch2(Op2Fetch{i, read_value_from_source(i.op1_addr)});
-      },
-      [this](const UnaryInstruction& i) -> std::optional<ExecutionEvent> {
-          return get_writeback(Writeback{i, read_value_from_source(i.op1_addr)}, i.res_addr);
-      },
-      [this](const JumpInstruction& i) -> std::optional<ExecutionEvent> {
-          return Writeback { i, read_value_from_source(i.offset_addr) }; // get_writeback(, DirectSource{0});
-      }
-    }, event.ins);
-  }
-
+  bool pc{false};
   /// <summary>
-  /// Execute Op2Fetch event on this cycle and get next cycle event.
+  /// Execute with two level cache memory model instead of flat memory.
   /// </summary>
-  /// <param name="event">
-  /// Op2Fetch event.
-  /// </param>
-  /// <returns>
-  /// Optional next cycle event for this instruction.
-  /// </returns>
-  constexpr auto handle_event(const Op2Fetch& event) {
-    fetch2++;
-    return std::visit(overloaded {
-      [this, &event](const BinaryInstruction& i) -> std::optional<ExecutionEvent> {
-          return calculate_value(i, event.op1, read_value_from_source(i.op2_addr));
-      },
-      [](const UnaryInstruction&) -> std::optional<ExecutionEvent> {
-          return Exception{std::string_view("UnaryInstruction pipelined Op2Fetch")};
-      },
-      [](const JumpInstruction&) -> std::optional<ExecutionEvent> {
-          return Exception{std::string_view("JumpInstruction pipelined Op2Fetch")};
-      }
-    }, event.ins);
-  }
-
+  bool cache{false};
   /// <summary>
-  /// Execute Execution event on this cycle and get next cycle event.
+  /// Execute with demand paged sparse memory instead of flat array.
   /// </summary>
-  /// <param name="event">
-  /// Execution event.
-  /// </param>
-  /// <returns>
-  /// Optional next cycle event for this instruction.
-  /// </returns>
-  constexpr auto handle_event(const Execution& event) {
-    exec++;
-    return std::visit(overloaded {
-      [&event] (const BinaryInstruction& i) -> std::optional<ExecutionEvent> {
-          return Writeback{i, BinaryInstruction::calculate(i, event.op1, event.op2)};
-      },
-      [&event](const UnaryInstruction& i) -> std::optional<ExecutionEvent>{
-          return Writeback{i, event.op1};
-      },
-      [&event](const JumpInstruction& i) -> std::optional<ExecutionEvent>{
-          return Writeback{i, event.op1};
-      }
-    }, event.ins);
-  }
-
+  bool paged{false};
   /// <summary>
-  /// Execute writeback event on this cycle.
+  /// Count of short runs forked from snapshot of warmed up state, zero for a single run.
   /// </summary>
-  /// <param name="event">
-  /// Writeback event.
-  /// </param>
-  /// <returns>
-  /// Next cycle event for this instruction.
-  /// Since writeback is final pipeline step, always empty optional.
-  /// </returns>
-  constexpr auto handle_event(const Writeback& event) {
-    writeback++;
-    std::visit(overloaded {
-      [this, &event] (const BinaryInstruction& i) {
-         put_value_to_source(i.res_addr, event.res);
-      },
-      [this, &event](const UnaryInstruction& i) {
-        put_value_to_source(i.res_addr, event.res);
-      },
-      [this, &event](const JumpInstruction&) {
-        put_value_to_source(DirectSource{0}, event.res);
-      }
-    }, event.ins);
-    return std::optional<ExecutionEvent> {};
-  }
-
+  std::size_t forks{0};
   /// <summary>
-  /// Execute exception event on this cycle.
+  /// Sampling period of sampled mode, zero for a detailed run.
   /// </summary>
-  /// <param name="">
-  /// Exception event.
-  /// </param>
-  /// <returns>
-  /// Optional next cycle event. 
-  /// Always empty optional.
-  /// </returns>
-  constexpr auto handle_event(const Exception&) {
-    exceptions++;
-    return std::optional<ExecutionEvent>{};
-  }
-
+  std::size_t sample{0};
   /// <summary>
-  /// Execute pipeline while next cycle event is avilable after execution this event.
+  /// Count host hardware events of simulation loop.
   /// </summary>
-  /// <param name="event">
-  /// ExecutionEvent to execute on cycle.
-  /// </param>
-  constexpr void handle_event(const ExecutionEvent& event) {
-    clk++;
-    const auto next_event = std::visit(overloaded {
-      [this](const auto& e) {
-        return handle_event(e);
-      }
-    }, event);
-    if (next_event)
-      handle_event(next_event.value());
-  }
-
+  bool perf{false};
+  /// <summary>
+  /// Interval of progress reports in milliseconds, zero for no reports.
+  /// </summary>
+  std::size_t progress{0};
+  /// <summary>
+  /// Count of the hottest instructions to report, zero for no profile.
+  /// </summary>
+  std::size_t profile{0};
+  /// <summary>
+  /// Maximum count of cycles to simulate by visitor engine.
+  /// </summary>
+  std::optional<std::size_t> cycles;
   /// <summary>
-  /// Execute instruction.
+  /// Milliseconds of wall clock time slices of visitor engine run, zero for a single slice.
   /// </summary>
-  /// <param name="i">
-  /// Instruction to execute.
-  /// </param>
-  /// <returns>
-  /// Nothing.
-  /// </returns>
-  constexpr auto execute(const Instruction& i) {
-    clk++; // instruction fetch+decode cycle
-    const auto event = get_fetch1(i);
-    if (event)
-      handle_event(event.value());
+  std::size_t slice{0};
+  /// <summary>
+  /// Count of simulated cores sharing data memory, zero for a single core run.
+  /// </summary>
+  std::size_t cores{0};
+  /// <summary>
+  /// Count of simulated cycles between barriers of multi-core run with quantum scheduler,
+  /// longer quanta run faster and hide more coherence cycles.
+  /// </summary>
+  std::size_t quantum{1000};
+  /// <summary>
+  /// Synchronization of cores in multi-core run.
+  /// </summary>
+  Scheduler scheduler{Scheduler::CONSERVATIVE};
+};
+
+/// <summary>
+/// Parse command line options.
+/// </summary>
+/// <returns>
+/// Parsed options, visitor engine by default.
+/// Empty optional if any option is unknown or malformed.
+/// </returns>
+auto parse_options(int argc, char** argv) -> std::optional<Options> {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    const std::string_view arg {argv[i]};
+    const auto number = [&arg](const std::string_view prefix) {
+      return arg.starts_with(prefix) ? parse_number(arg.substr(prefix.size())) : std::optional<std::size_t>{};
+    };
+    if (arg == "--engine=visitor") options.engine = Engine::VISITOR;
+    else if (arg == "--engine=decoded") options.engine = Engine::DECODED;
+    else if (arg == "--engine=threaded") options.engine = Engine::THREADED;
+    else if (arg == "--engine=block") options.engine = Engine::BLOCK;
+    else if (arg == "--engine=jit") options.engine = Engine::JIT;
+    else if (arg == "--engine=functional") options.engine = Engine::FUNCTIONAL;
+    else if (const auto count = number("--count=")) options.count = *count;
+    else if (const auto jobs = number("--batch=")) options.jobs = *jobs;
+    else if (const auto threads = number("--threads=")) options.threads = *threads;
+    else if (arg.starts_with("--program=")) options.program = arg.substr(10);
+    else if (arg.starts_with("--save=")) options.save = arg.substr(7);
+    else if (arg.starts_with("--trace=")) options.trace = arg.substr(8);
+    else if (arg == "--pc") options.pc = true;
+    else if (arg == "--cache") options.cache = true;
+    else if (arg == "--paged") options.paged = true;
+    else if (arg == "--perf") options.perf = true;
+    else if (const auto forks = number("--forks=")) options.forks = *forks;
+    else if (const auto sample = number("--sample=")) options.sample = *sample;
+    else if (const auto progress = number("--progress=")) options.progress = *progress;
+    else if (const auto profile = number("--profile=")) options.profile = *profile;
+    else if (const auto cycles = number("--cycles=")) options.cycles = *cycles;
+    else if (const auto slice = number("--slice=")) options.slice = *slice;
+    else if (const auto cores = number("--cores=")) options.cores = *cores;
+    else if (const auto quantum = number("--quantum="); quantum > 0) options.quantum = *quantum;
+    else if (arg == "--scheduler=quantum") options.scheduler = Scheduler::QUANTUM;
+    else if (arg == "--scheduler=conservative") options.scheduler = Scheduler::CONSERVATIVE;
+    else if (arg == "--pipeline=stall") options.pipeline = HazardPolicy::STALL;
+    else if (arg == "--pipeline=forward") options.pipeline = HazardPolicy::FORWARD;
+    else if (const auto lanes = number("--lanes="); lanes == 8 || lanes == 16 || lanes == 32) options.lanes = *lanes;
+    else return std::optional<Options>{};
   }
+  return options;
+}
 
-};
+/// <summary>
+/// Execute program on lanes, every lane starts with its index in regs[0].
+/// </summary>
+template<std::size_t Lanes>
+auto run_lanes(std::span<const Instruction> program, const std::size_t count) {
+  auto state = std::make_unique<LaneState<Lanes>>();
+  for (std::size_t lane = 0; lane < Lanes; lane++) {
+    State initial {};
+    initial.regs[0] = static_cast<State::word_type>(lane);
+    state->set_lane(lane, initial);
+  }
+  const auto start = std::chrono::steady_clock::now();
+  run(*state, decode(program), count);
+  const auto end = std::chrono::steady_clock::now();
+  const auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+  fprintf(stderr, "CYCLE %zu\n", state->clk);
+  for (std::size_t lane = 0; lane < Lanes; lane++) {
+    fprintf(stderr, "REGS%-2zu ", lane);
+    hexdump(state->get_lane(lane).regs, 16);
+  }
+  fprintf(stderr, "lanes: %zu\n", Lanes);
+  fprintf(stderr, "delta: %lld\n", static_cast<long long>(delta));
+  fprintf(stderr, "approx. %zu khz\n", state->clk * Lanes / static_cast<std::size_t>(delta > 0 ? delta : 1));
+}
 
-int main() {
-  State state {};
-  std::array<Instruction, 8> inss{
-    UnaryInstruction { ImmidiateSource{1}, DirectSource{1} },
-    UnaryInstruction { ImmidiateSource{2}, DirectSource{2} },
+/// <summary>
+/// Warm up state with visitor engine, then fork short runs from its snapshot.
+/// </summary>
+auto run_forks(std::span<const Instruction> program, const std::size_t count, const std::size_t forks) {
+  constexpr std::size_t fork_length = 1000;
+  auto state = std::make_unique<CheckpointState>();
+  state->run(program, RunBudget {count});
+  auto snapshot = std::make_unique<Snapshot<CheckpointState>>();
+  capture(*snapshot, *state);
+  std::size_t clk = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (std::size_t fork = 0; fork < forks; fork++) {
+    restore(*state, *snapshot);
+    for (std::size_t i = count; i < count + fork_length; i++) {
+      state->execute(program[i % program.size()]);
+    }
+    clk += state->clk - snapshot->state.clk;
+  }
+  const auto end = std::chrono::steady_clock::now();
+  const auto delta = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+  fprintf(stderr, "CYCLE %zu\n", snapshot->state.clk);
+  fprintf(stderr, "forks: %zu\n", forks);
+  fprintf(stderr, "fork length: %zu\n", fork_length);
+  fprintf(stderr, "fork clk: %zu\n", clk);
+  fprintf(stderr, "us per fork: %.3f\n", static_cast<double>(delta) / static_cast<double>(forks > 0 ? forks : 1));
+}
 
-    UnaryInstruction { DirectSource{1}, IndirectSource{1} },
-    UnaryInstruction { DirectSource{2}, IndirectSource{2} },
+/// <summary>
+/// Execute program on cores sharing data memory, every core starts with its index in regs[0].
+/// </summary>
+auto run_multicore(std::span<const Instruction> program, const std::size_t count, const Options& options) {
+  const auto ops = decode(program);
+  auto cpu = std::make_unique<MultiCore>(options.cores);
+  for (std::size_t i = 0; i < cpu->cores.size(); i++) {
+    auto& core = cpu->cores[i];
+    core.program = ops;
+    core.count = count;
+    core.regs[0] = static_cast<State::word_type>(i);
+  }
+  const auto start = std::chrono::steady_clock::now();
+  cpu->run(options.scheduler, options.quantum, options.threads);
+  const auto end = std::chrono::steady_clock::now();
+  const auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+  std::size_t clk = 0;
+  std::size_t cycles = 0;
+  std::size_t coherence = 0;
+  std::size_t waits = 0;
+  for (std::size_t i = 0; i < cpu->cores.size(); i++) {
+    const auto& core = cpu->cores[i];
+    fprintf(stderr, "CORE%-2zu clk %zu coherence %zu misses %zu upgrades %zu REGS ", i, core.clk, core.coherence, core.misses, core.upgrades);
+    hexdump(core.regs, 16);
+    clk = std::max(clk, core.clk);
+    cycles += core.clk;
+    coherence += core.coherence;
+    waits += core.waits;
+  }
+  fprintf(stderr, "RAM  ");
+  hexdump(cpu->data, 16);
+  fprintf(stderr, "CYCLE %zu\n", clk);
+  fprintf(stderr, "cores: %zu\n", cpu->cores.size());
+  if (options.scheduler == Scheduler::QUANTUM) fprintf(stderr, "quanta: %zu\n", cpu->quanta);
+  else fprintf(stderr, "waits: %zu\n", waits);
+  fprintf(stderr, "coherence: %zu (%.2f%% of cycles)\n", coherence,
+          100.0 * static_cast<double>(coherence) / static_cast<double>(cycles > 0 ? cycles : 1));
+  fprintf(stderr, "delta: %lld\n", static_cast<long long>(delta));
+  fprintf(stderr, "approx. %zu khz\n", cycles / static_cast<std::size_t>(delta > 0 ? delta : 1));
+}
 
-    BinaryInstruction { IndirectSource {1}, IndirectSource{2}, IndirectSource{3}, BinaryOperation::ADD },
-    UnaryInstruction { IndirectSource {3}, DirectSource {3} },
-    BinaryInstruction { DirectSource {1}, DirectSource {3}, DirectSource {1}, BinaryOperation::ADD },
-    JumpInstruction { DirectSource {1} }
-  };
+/// <summary>
+/// Print cycle counter, registers and the beginning of memory.
+/// </summary>
+/// <param name="pc">
+/// Program counter to print, not printed when empty.
+/// </param>
+template<typename Word>
+auto dump(const std::size_t clk, const Word* regs, const Word* ram, const std::optional<std::size_t> pc = {}) {
+  fprintf(stderr, "CYCLE %zu\n", clk);
+  if (pc) fprintf(stderr, "PC %zu\n", *pc);
+  fprintf(stderr, "REGS ");
+  hexdump(regs, 16);
+  fprintf(stderr, "RAM  ");
+  hexdump(ram, 16);
+}
+
+template<typename S>
+auto dump(const S& state, const std::optional<std::size_t> pc = {}) {
+  dump(state.clk, state.regs, state.data, pc);
+}
+
+/// <summary>
+/// Execute program with visitor engine on two level cache memory model.
+/// </summary>
+auto run_cached(std::span<const Instruction> program, const std::size_t count) {
+  BasicState<16, 1024, MachineWord, TwoLevelCache> state {};
+  const auto start = std::chrono::steady_clock::now();
+  state.run(program, RunBudget {count});
+  const auto end = std::chrono::steady_clock::now();
+  const auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+  dump(state);
+  fprintf(stderr, "delta: %lld\n", static_cast<long long>(delta));
+  const auto& [l1, l2] = state.memory.levels;
+  fprintf(stderr, "L1 hits: %zu\n", l1.hits);
+  fprintf(stderr, "L1 misses: %zu\n", l1.misses);
+  fprintf(stderr, "L2 hits: %zu\n", l2.hits);
+  fprintf(stderr, "L2 misses: %zu\n", l2.misses);
+}
+
+/// <summary>
+/// Execute program with visitor engine on demand paged sparse memory.
+/// </summary>
+auto run_paged(std::span<const Instruction> program, const std::size_t count) {
+  auto state = std::make_unique<SparseState>();
+  const auto start = std::chrono::steady_clock::now();
+  state->run(program, RunBudget {count});
+  const auto end = std::chrono::steady_clock::now();
+  const auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+  MachineWord ram[16];
+  for (std::size_t i = 0; i < 16; i++) ram[i] = std::as_const(state->data)[i];
+  dump(state->clk, state->regs, ram);
+  fprintf(stderr, "delta: %lld\n", static_cast<long long>(delta));
+  fprintf(stderr, "resident pages: %zu\n", state->data.resident());
+  fprintf(stderr, "TLB hits: %zu\n", state->data.tlb_hits);
+  fprintf(stderr, "TLB misses: %zu\n", state->data.tlb_misses);
+}
+
+int main(int argc, char** argv) {
+  const auto options = parse_options(argc, argv);
+  if (!options) {
+    fprintf(stderr, "usage: %s [--engine=visitor|decoded|threaded|block|jit|functional] [--count=N] [--batch=JOBS] [--threads=N] [--lanes=8|16|32] [--pipeline=stall|forward] [--program=FILE] [--save=FILE] [--trace=FILE] [--pc] [--cache] [--paged] [--forks=N] [--sample=PERIOD] [--perf] [--progress=MS] [--profile=N] [--cycles=N] [--slice=MS] [--cores=N] [--quantum=CYCLES] [--scheduler=conservative|quantum]\n"
+                    "--scheduler=quantum is approximate: coherence cycles shrink as --quantum grows, --quantum=1 approaches conservative scheduler\n", argv[0]);
+    return 1;
+  }
+
+  State state {};
+  auto inss = fixtures::sample;
 
   const auto metrics = [&state](const auto& start, const std::size_t count, const bool full) {
     const auto end = std::chrono::steady_clock::now();
     const auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-    const auto ipms = state.clk / (delta > 0 ? delta : 1);
+    const auto ipms = state.clk / static_cast<std::size_t>(delta > 0 ? delta : 1);
     if (full) {
-      fprintf(stderr, "approx. %llu khz\n", ipms);
-      fprintf(stderr, "instructions executed: %ld\n", count);
-      fprintf(stderr, "delta: %lld\n", delta);
+      fprintf(stderr, "approx. %zu khz\n", ipms);
+      fprintf(stderr, "instructions executed: %zu\n", count);
+      fprintf(stderr, "delta: %lld\n", static_cast<long long>(delta));
       fprintf(stderr, "clk %zu\n", state.clk);
-      fprintf(stderr, "fetch1: %lu\n", state.fetch1);
-      fprintf(stderr, "fetch2: %lu\n", state.fetch2);
-      fprintf(stderr, "exec: %lu\n", state.exec);
-      fprintf(stderr, "writeback: %lu\n", state.writeback);
-      fprintf(stderr, "exceptions: %lu\n", state.exceptions);
+      fprintf(stderr, "fetch1: %zu\n", state.fetch1);
+      fprintf(stderr, "fetch2: %zu\n", state.fetch2);
+      fprintf(stderr, "exec: %zu\n", state.exec);
+      fprintf(stderr, "writeback: %zu\n", state.writeback);
+      fprintf(stderr, "exceptions: %zu\n", state.exceptions);
     } else [[likely]] {
-      fprintf(stderr, "approx. %llu khz\r", ipms);
+      fprintf(stderr, "approx. %zu khz\r", ipms);
     }
   };
 
-  const auto count = 12800000800;
+  if (!options->save.empty()) {
+    try {
+      write_program(options->save, inss, state);
+    } catch (const std::runtime_error& e) {
+      fprintf(stderr, "%s\n", e.what());
+      return 1;
+    }
+    return 0;
+  }
+
+  if (!options->program.empty()) {
+    try {
+      const ProgramFile file {options->program};
+      file.load(state);
+      const auto count = options->count.value_or(file.instructions().size());
+      const auto start = std::chrono::steady_clock::now();
+      run(state, file, count);
+      dump(state);
+      metrics(start, count, true);
+    } catch (const std::runtime_error& e) {
+      fprintf(stderr, "%s\n", e.what());
+      return 1;
+    }
+    return 0;
+  }
+
+  const auto count = options->count.value_or(12800000800);
+
+#ifdef CYCLE_SIMULATOR_TRACE
+  std::unique_ptr<TraceWriter> trace;
+  if (!options->trace.empty()) {
+    try {
+      trace = std::make_unique<TraceWriter>(options->trace);
+    } catch (const std::runtime_error& e) {
+      fprintf(stderr, "%s\n", e.what());
+      return 1;
+    }
+    state.trace = trace.get();
+  }
+#else
+  if (!options->trace.empty()) {
+    fprintf(stderr, "tracing is compiled out, configure with -DCYCLE_SIMULATOR_TRACE=ON\n");
+    return 1;
+  }
+#endif
+  if (options->jobs > 0) {
+    std::vector<Job> jobs(options->jobs);
+    for (std::size_t i = 0; i < jobs.size(); i++) {
+      jobs[i].program.assign(inss.begin(), inss.end());
+      jobs[i].regs[0] = static_cast<State::word_type>(i);
+      jobs[i].count = count;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const auto results = run_batch(jobs, options->threads);
+    const auto end = std::chrono::steady_clock::now();
+    const auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    std::size_t clk = 0;
+    for (const auto& result : results)
+      clk += result.clk;
+    fprintf(stderr, "jobs: %zu\n", results.size());
+    fprintf(stderr, "delta: %lld\n", static_cast<long long>(delta));
+    fprintf(stderr, "approx. %zu khz\n", clk / static_cast<std::size_t>(delta > 0 ? delta : 1));
+    fprintf(stderr, "clk %zu\n", clk);
+    return 0;
+  }
+
+  if (options->cores > 0) {
+    run_multicore(inss, count, *options);
+    return 0;
+  }
+
+  switch (options->lanes) {
+    case 8: run_lanes<8>(inss, count); return 0;
+    case 16: run_lanes<16>(inss, count); return 0;
+    case 32: run_lanes<32>(inss, count); return 0;
+  }
+
+  if (options->pipeline) {
+    Pipeline pipeline {*options->pipeline};
+    const auto start = std::chrono::steady_clock::now();
+    run(state, pipeline, decode(inss), count);
+    dump(state);
+    metrics(start, count, true);
+    fprintf(stderr, "retired: %zu\n", pipeline.retired);
+    fprintf(stderr, "CPI: %.3f\n", static_cast<double>(state.clk) / static_cast<double>(pipeline.retired > 0 ? pipeline.retired : 1));
+    fprintf(stderr, "stalls: %zu\n", pipeline.stalls);
+    fprintf(stderr, "memory stalls: %zu\n", pipeline.memory_stalls);
+    fprintf(stderr, "forwards: %zu\n", pipeline.forwards);
+    return 0;
+  }
+
+  if (options->cache) {
+    run_cached(inss, count);
+    return 0;
+  }
+
+  if (options->paged) {
+    run_paged(inss, count);
+    return 0;
+  }
+
+  if (options->sample > 0) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto estimate = run_sampled(state, inss, decode(inss), count, SamplingConfig {options->sample});
+    const auto end = std::chrono::steady_clock::now();
+    const auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    fprintf(stderr, "REGS ");
+    hexdump(state.regs, 16);
+    fprintf(stderr, "RAM  ");
+    hexdump(state.data, 16);
+    fprintf(stderr, "instructions executed: %zu\n", count);
+    fprintf(stderr, "detailed: %zu in %zu samples\n", estimate.detailed, estimate.samples);
+    fprintf(stderr, "delta: %lld\n", static_cast<long long>(delta));
+    fprintf(stderr, "estimated clk %zu\n", estimate.clk);
+    fprintf(stderr, "CPI: %.4f +- %.4f\n", estimate.cpi, estimate.cpi_error);
+    fprintf(stderr, "fetch1: %zu\n", estimate.fetch1);
+    fprintf(stderr, "fetch2: %zu\n", estimate.fetch2);
+    fprintf(stderr, "writeback: %zu\n", estimate.writeback);
+    fprintf(stderr, "exceptions: %zu\n", estimate.exceptions);
+    return 0;
+  }
+
+  if (options->cycles || options->slice > 0) {
+    // run returns control on every deadline and is resumed, as a scheduler sharing a thread with other simulations would do
+    RunBudget budget {count, options->cycles.value_or(std::numeric_limits<std::size_t>::max())};
+    std::size_t executed = 0;
+    std::size_t next = 0;
+    std::size_t slices = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (;;) {
+      if (options->slice > 0) budget.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds {options->slice};
+      const auto result = state.run(inss, budget, next);
+      executed += result.executed;
+      next = result.next;
+      slices++;
+      budget.instructions -= result.executed;
+      if (budget.cycles != std::numeric_limits<std::size_t>::max())
+        budget.cycles -= std::min(budget.cycles, result.cycles);
+      if (result.reason != StopReason::DEADLINE) break;
+    }
+    dump(state);
+    metrics(start, executed, true);
+    fprintf(stderr, "slices: %zu\n", slices);
+    return 0;
+  }
+
+  if (options->forks > 0) {
+    run_forks(inss, count, options->forks);
+    return 0;
+  }
+
+  if (options->pc) {
+    // same program looping by jump back to the first instruction after initialization
+    auto loop = inss;
+    loop.back() = JumpInstruction { ImmidiateSource {-5} };
+    std::size_t executed = 0;
+    const auto start = std::chrono::steady_clock::now();
+    switch (options->engine) {
+      case Engine::VISITOR:
+        executed = state.run_steps(loop, RunBudget {count}).executed;
+        break;
+      case Engine::DECODED: {
+        const auto ops = decode(loop);
+        for (; executed < count && state.pc < ops.size(); executed++) step(state, ops);
+        break;
+      }
+      default:
+        fprintf(stderr, "only visitor and decoded engines execute by program counter\n");
+        return 1;
+    }
+    dump(state, state.pc);
+    metrics(start, executed, true);
+    fprintf(stderr, "branch hits: %zu\n", state.btb.hits);
+    fprintf(stderr, "branch misses: %zu\n", state.btb.misses);
+    return 0;
+  }
+
+  std::optional<PerfCounters> perf;
+  if (options->perf) perf.emplace();
+  Progress progress;
+  std::optional<ProgressReporter> reporter;
+  if (options->progress > 0) reporter.emplace(progress, std::chrono::milliseconds {options->progress});
+  // publish progress about every millisecond of the visitor engine, a few times per millisecond of JIT
+  const auto chunk = options->progress > 0 ? inss.size() << 14 : 0;
+  const auto execute = [&](auto&& run) { run_with_progress(state, &progress, count, chunk, run); };
+
+  Profile profile;
+  if (perf) perf->start();
   const auto start = std::chrono::steady_clock::now();
-  for (std::size_t i = 0; i < count; i++) {
-    state.execute(inss[i % inss.size()]);
+  switch (options->engine) {
+    case Engine::VISITOR:
+      if (options->profile > 0) {
+        execute([&](const std::size_t n) { run_profiled(state, std::span<const Instruction> {inss}, n, profile); });
+        break;
+      }
+      execute([&](const std::size_t n) { state.run(inss, RunBudget {n}); });
+      break;
+    case Engine::DECODED: {
+      const auto ops = decode(inss);
+      execute([&](const std::size_t n) { run(state, ops, n); });
+      break;
+    }
+    case Engine::THREADED: {
+      const auto ops = compile(inss);
+      execute([&](const std::size_t n) { run(state, ops, n); });
+      break;
+    }
+    case Engine::BLOCK: {
+      auto cache = make_block_cache(inss);
+      execute([&](const std::size_t n) { run(state, cache, n); });
+      break;
+    }
+    case Engine::JIT: {
+      auto jit = make_jit_program(inss);
+      if (!jit.code) fprintf(stderr, "jit is not available, falling back to block engine\n");
+      execute([&](const std::size_t n) { run(state, jit, n); });
+      break;
+    }
+    case Engine::FUNCTIONAL: {
+      const auto program = make_functional_program(inss);
+      execute([&](const std::size_t n) { run(state, program, n); });
+      break;
+    }
   }
-  fprintf(stderr, "CYCLE %d\n", state.clk);
-  fprintf(stderr, "REGS ");
-  hexdump(state.regs, 16);
-  fprintf(stderr, "RAM  ");
-  hexdump(state.data, 16);
+  if (perf) perf->stop();
+  reporter.reset();
+  dump(state);
   metrics(start, count, true);
+  if (perf) {
+    const auto counters = perf->read();
+    for (std::size_t i = 0; i < host_events; i++) {
+      if (counters[i]) {
+        fprintf(stderr, "%s: %llu (%.3f per instruction)\n", host_event_names[i], static_cast<unsigned long long>(*counters[i]),
+                static_cast<double>(*counters[i]) / static_cast<double>(count > 0 ? count : 1));
+      } else {
+        fprintf(stderr, "%s: unavailable\n", host_event_names[i]);
+      }
+    }
+  }
+  if (options->profile > 0) {
+    // timing of pre-decoded engines doesn't depend on values, so their profile is derived from costs
+    if (options->engine != Engine::VISITOR) profile = profile_of(decode(inss), count);
+    if (options->engine == Engine::FUNCTIONAL) {
+      fprintf(stderr, "functional engine doesn't count cycles, profile is derived from original program\n");
+    }
+    std::size_t cycles = 0;
+    for (const auto& p : profile) cycles += p.cycles;
+    fprintf(stderr, "hottest instructions:\n");
+    for (const auto i : hottest(profile, options->profile)) {
+      const auto& p = profile[i];
+      fprintf(stderr, "  #%zu: executed %zu, cycles %zu (%.1f%%), memory stalls %zu\n", i, p.executed, p.cycles,
+              100.0 * static_cast<double>(p.cycles) / static_cast<double>(cycles > 0 ? cycles : 1), p.memory_stalls);
+    }
+  }
 }
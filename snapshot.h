@@ -0,0 +1,191 @@
+#ifndef snapshot_h_
+#define snapshot_h_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+#include "state.h"
+#include "memory.h"
+#include "pipeline.h"
+
+/// <summary>
+/// Memory model which tracks pages written since state was synchronized with a snapshot.
+/// Timing is the one of inner memory model.
+/// Only writes accounted by memory model are tracked, so state should be executed by visitor engine.
+/// </summary>
+template<std::size_t Pages, std::size_t PageSize = 64, typename Inner = FlatMemory>
+struct DirtyPages {
+  static_assert(Pages > 0 && PageSize > 0);
+
+  static constexpr std::size_t pages = Pages;
+  static constexpr std::size_t page_size = PageSize;
+
+  [[no_unique_address]] Inner inner{};
+  std::array<bool, Pages> dirty{};
+  /// <summary>
+  /// Indices of dirty pages, so restore takes time of written pages only.
+  /// </summary>
+  std::array<std::uint32_t, Pages> list{};
+  std::size_t count{0};
+  /// <summary>
+  /// Snapshot state is synchronized with, dirty pages are relative to it.
+  /// </summary>
+  const void* synced{nullptr};
+  /// <summary>
+  /// Generation of snapshot state is synchronized with, snapshot is changed by capture since when it differs.
+  /// </summary>
+  std::size_t synced_generation{0};
+
+  constexpr auto access(const std::size_t addr, const bool write) {
+    if (write) {
+      const auto page = addr / PageSize;
+      if (!dirty[page]) {
+        dirty[page] = true;
+        list[count++] = static_cast<std::uint32_t>(page);
+      }
+    }
+    return inner.access(addr, write);
+  }
+
+  constexpr auto clear() {
+    for (std::size_t i = 0; i < count; i++)
+      dirty[list[i]] = false;
+    count = 0;
+  }
+};
+
+/// <summary>
+/// Saved state with pipeline in flight.
+/// </summary>
+template<typename S>
+struct Snapshot {
+  S state{};
+  Pipeline pipeline{};
+  /// <summary>
+  /// Count of captures into snapshot, so states synchronized with an older content of it are told apart.
+  /// </summary>
+  std::size_t generation{0};
+};
+
+/// <summary>
+/// Copy everything but memory and trace sink.
+/// </summary>
+template<typename S>
+constexpr auto copy_registers(S& to, const S& from) {
+  std::copy(std::begin(from.regs), std::end(from.regs), std::begin(to.regs));
+  to.clk = from.clk;
+  to.pc = from.pc;
+  to.btb = from.btb;
+  to.fetch1 = from.fetch1;
+  to.fetch2 = from.fetch2;
+  to.exec = from.exec;
+  to.writeback = from.writeback;
+  to.exceptions = from.exceptions;
+  to.last_exception = from.last_exception;
+#ifdef CYCLE_SIMULATOR_TRACE
+  to.instructions = from.instructions;
+#endif
+}
+
+/// <summary>
+/// Copy memory pages dirty in state from one copy of state into another.
+/// Whole memory is copied when state isn't synchronized with the current generation of snapshot
+/// or memory isn't tracked.
+/// </summary>
+template<typename S>
+constexpr auto copy_memory(S& to, const S& from, const S& tracked, const Snapshot<S>& snapshot) {
+  if constexpr (requires { tracked.memory.dirty; }) {
+    typedef decltype(tracked.memory) Tracking;
+    static_assert(Tracking::pages * Tracking::page_size >= S::mem_size, "dirty pages should cover memory");
+    if (tracked.memory.synced == &snapshot && tracked.memory.synced_generation == snapshot.generation) {
+      for (std::size_t i = 0; i < tracked.memory.count; i++) {
+        const auto begin = tracked.memory.list[i] * Tracking::page_size;
+        const auto end = std::min(begin + Tracking::page_size, S::mem_size);
+        std::copy(from.data + begin, from.data + end, to.data + begin);
+      }
+      return;
+    }
+  }
+  std::copy(std::begin(from.data), std::end(from.data), std::begin(to.data));
+}
+
+/// <summary>
+/// Mark state synchronized with the current generation of snapshot.
+/// </summary>
+template<typename S>
+constexpr auto synchronize(S& state, const Snapshot<S>& snapshot) {
+  if constexpr (requires { state.memory.dirty; }) {
+    state.memory.clear();
+    state.memory.synced = &snapshot;
+    state.memory.synced_generation = snapshot.generation;
+  }
+}
+
+/// <summary>
+/// Save state into snapshot.
+/// When state was synchronized with this snapshot, only pages written since are copied.
+/// Capture starts a new generation of snapshot, so other states synchronized with it restore whole memory.
+/// </summary>
+/// <param name="snapshot">
+/// Snapshot to save into.
+/// </param>
+/// <param name="state">
+/// State to save.
+/// </param>
+template<typename S>
+constexpr auto capture(Snapshot<S>& snapshot, S& state) {
+  copy_memory(snapshot.state, state, state, snapshot);
+  copy_registers(snapshot.state, state);
+  snapshot.state.memory = state.memory;
+  snapshot.generation++;
+  synchronize(state, snapshot);
+}
+
+/// <summary>
+/// Save state and pipeline in flight into snapshot.
+/// </summary>
+template<typename S>
+constexpr auto capture(Snapshot<S>& snapshot, S& state, const Pipeline& pipeline) {
+  capture(snapshot, state);
+  snapshot.pipeline = pipeline;
+}
+
+/// <summary>
+/// Restore state from snapshot.
+/// When state was synchronized with the current generation of snapshot, only pages written since are copied,
+/// so forking many short runs from a single snapshot takes time of their writes only.
+/// Trace sink of state is kept.
+/// </summary>
+/// <param name="state">
+/// State to restore.
+/// </param>
+/// <param name="snapshot">
+/// Snapshot to restore from.
+/// </param>
+template<typename S>
+constexpr auto restore(S& state, const Snapshot<S>& snapshot) {
+  copy_memory(state, snapshot.state, state, snapshot);
+  copy_registers(state, snapshot.state);
+  state.memory = snapshot.state.memory;
+  synchronize(state, snapshot);
+}
+
+/// <summary>
+/// Restore state and pipeline in flight from snapshot.
+/// Pipeline latches refer to micro-ops of the program it was captured on.
+/// </summary>
+template<typename S>
+constexpr auto restore(S& state, Pipeline& pipeline, const Snapshot<S>& snapshot) {
+  restore(state, snapshot);
+  pipeline = snapshot.pipeline;
+}
+
+/// <summary>
+/// Default state with memory tracked by 64 B pages.
+/// </summary>
+typedef BasicState<16, 1024, MachineWord, DirtyPages<16>> CheckpointState;
+
+#endif
@@ -3,8 +3,10 @@
 
 #include <variant>
 
+#include "word.h"
+
 struct ImmidiateSource {
-  int value;
+  Value value;
 };
 
 struct DirectSource {
@@ -0,0 +1,707 @@
+#ifndef state_h_
+#define state_h_
+
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <type_traits>
+
+#include "utilities.h"
+#include "source.h"
+#include "instruction.h"
+#include "event.h"
+#include "branch.h"
+#include "memory.h"
+#include "paging.h"
+
+#ifdef CYCLE_SIMULATOR_TRACE
+#include "trace.h"
+#endif
+
+/// <summary>
+/// Limits of State::run, run stops on the first limit reached
+/// and returns control to caller on instruction boundary, so it could be resumed later.
+/// </summary>
+struct RunBudget {
+  /// <summary>
+  /// Count of instructions to execute, program is repeated from the start when ends.
+  /// </summary>
+  std::size_t instructions{std::numeric_limits<std::size_t>::max()};
+  /// <summary>
+  /// Count of cycles to execute. Checked on instruction boundaries,
+  /// so the last instruction might overrun it by a few cycles.
+  /// </summary>
+  std::size_t cycles{std::numeric_limits<std::size_t>::max()};
+  /// <summary>
+  /// Stop after the first instruction raising an Exception.
+  /// </summary>
+  bool stop_on_exception{false};
+  /// <summary>
+  /// Wall clock time to stop at.
+  /// </summary>
+  std::optional<std::chrono::steady_clock::time_point> deadline{};
+  /// <summary>
+  /// Count of instructions between deadline checks, reading clock costs much more than an instruction.
+  /// </summary>
+  std::size_t deadline_interval{1024};
+};
+
+enum struct StopReason {
+  INSTRUCTIONS,
+  CYCLES,
+  EXCEPTION,
+  DEADLINE,
+  /// <summary>
+  /// Program counter left program.
+  /// </summary>
+  HALTED
+};
+
+/// <summary>
+/// Outcome of State::run.
+/// </summary>
+struct RunResult {
+  /// <summary>
+  /// Count of instructions executed.
+  /// </summary>
+  std::size_t executed;
+  /// <summary>
+  /// Count of cycles spent by run.
+  /// </summary>
+  std::size_t cycles;
+  StopReason reason;
+  /// <summary>
+  /// Exception stopped run when stopped on exception.
+  /// </summary>
+  std::optional<ExceptionCode> exception;
+  /// <summary>
+  /// Index of instruction to resume run from.
+  /// </summary>
+  std::size_t next;
+};
+
+/// <summary>
+/// Checks of budget limits but instruction count, done on instruction boundaries.
+/// </summary>
+struct RunGuard {
+  const RunBudget& budget;
+  /// <summary>
+  /// Cycle counter value to stop at.
+  /// </summary>
+  std::size_t limit;
+  /// <summary>
+  /// Any check is needed, otherwise run skips guard entirely.
+  /// </summary>
+  bool checked;
+  std::size_t countdown;
+
+  constexpr RunGuard(const RunBudget& budget, const std::size_t clk)
+      : budget{budget},
+        limit{budget.cycles < std::numeric_limits<std::size_t>::max() - clk ? clk + budget.cycles : std::numeric_limits<std::size_t>::max()},
+        checked{budget.stop_on_exception || budget.deadline || limit != std::numeric_limits<std::size_t>::max()},
+        countdown{std::max<std::size_t>(budget.deadline_interval, 1)} {}
+
+  /// <summary>
+  /// Limit reached before run starts.
+  /// </summary>
+  constexpr auto initial(const std::size_t clk) const -> std::optional<StopReason> {
+    if (clk >= limit) return StopReason::CYCLES;
+    if (budget.deadline && std::chrono::steady_clock::now() >= *budget.deadline) return StopReason::DEADLINE;
+    return std::nullopt;
+  }
+
+  /// <summary>
+  /// Limit reached by instruction just executed.
+  /// </summary>
+  constexpr auto check(const std::size_t clk, const bool raised) -> std::optional<StopReason> {
+    if (raised && budget.stop_on_exception) return StopReason::EXCEPTION;
+    if (clk >= limit) return StopReason::CYCLES;
+    if (budget.deadline && --countdown == 0) {
+      countdown = std::max<std::size_t>(budget.deadline_interval, 1);
+      if (std::chrono::steady_clock::now() >= *budget.deadline) return StopReason::DEADLINE;
+    }
+    return std::nullopt;
+  }
+};
+
+/// <summary>
+/// CPU state specialized by register count, memory size, word type, timing policy and data storage.
+/// Timing policy is a memory model which accounts every IndirectSource access,
+/// flat memory keeps single cycle access with no overhead.
+/// Data storage is an inline array by default or any type indexed like it, e.g. PagedMemory.
+/// </summary>
+template<std::size_t RegCount = 16, std::size_t MemSize = 1024, typename Word = MachineWord, typename Memory = FlatMemory,
+         typename Data = Word[MemSize]>
+struct BasicState {
+  static_assert(RegCount > 0 && MemSize > 0);
+  static_assert(std::is_unsigned_v<Word>, "values are truncated into unsigned words on store");
+
+  typedef Word word_type;
+  static constexpr std::size_t reg_count = RegCount;
+  static constexpr std::size_t mem_size = MemSize;
+
+  // Memory
+  
+  /// <summary>
+  /// Registers are available in CPU and doesn't take an extra cycle to access.
+  /// </summary>
+  Word regs[RegCount]{0};
+  /// <summary>
+  /// RAM access is takes an extra cycle to access.
+  /// </summary>
+  Data data{};
+
+  // Cycle counter
+  std::size_t clk{0};
+
+  // Program counter, used only by program stepping
+  std::size_t pc{0};
+  BranchTargetBuffer btb{};
+
+  // Metrics
+  std::size_t fetch1{0};
+  std::size_t fetch2{0};
+  std::size_t exec{0};
+  std::size_t writeback{0};
+  std::size_t exceptions{0};
+  /// <summary>
+  /// Code of the last raised exception, valid when exceptions isn't zero.
+  /// </summary>
+  ExceptionCode last_exception{};
+
+#ifdef CYCLE_SIMULATOR_TRACE
+  /// <summary>
+  /// Trace sink of every cycle, tracing is disabled when empty.
+  /// </summary>
+  TraceWriter* trace{nullptr};
+  /// <summary>
+  /// Sequence number of instruction being executed.
+  /// </summary>
+  std::size_t instructions{0};
+#endif
+
+  [[no_unique_address]] Memory memory{};
+
+  /// <summary>
+  /// Unwrap source into a raw value.
+  /// </summary>
+  /// <param name="source">
+  /// Source to unwrap.
+  /// DirectSource will read from register.
+  /// IndirectSource will read from memory.
+  /// ImmidiateSource will just return a immidiate value.
+  /// </param>
+  /// <returns>
+  /// Unwarpped value.
+  /// </returns>
+  constexpr auto read_value_from_source(const Source& source) {
+    return std::visit(overloaded {
+       [this](const DirectSource& s) {
+         return static_cast<Value>(regs[s.reg]);
+       },
+       [this](const IndirectSource& s) {
+         clk += memory.access(static_cast<std::size_t>(s.addr), false) - 1;
+         return static_cast<Value>(data[s.addr]);
+       },
+       [](const ImmidiateSource& s) {
+         return s.value;
+       }
+    }, source);
+  }
+
+  /// <summary>
+  /// Unwrap source into a raw value without memory access accounting.
+  /// </summary>
+  constexpr auto peek_value_from_source(const Source& source) const {
+    return std::visit(overloaded {
+       [this](const DirectSource& s) {
+         return static_cast<Value>(regs[s.reg]);
+       },
+       [this](const IndirectSource& s) {
+         return static_cast<Value>(data[s.addr]);
+       },
+       [](const ImmidiateSource& s) {
+         return s.value;
+       }
+    }, source);
+  }
+
+  /// <summary>
+  /// Unwrap source and write value to referenced pointer.
+  /// </summary>
+  /// <param name="source">
+  /// Source to unwrap and write value.
+  /// DirectSource will write to registers.
+  /// IndirectSource will write to memory.
+  /// ImmidiateSource will store nothing because writing to immidiate is quite a strange thing to do.
+  /// </param>
+  /// <param name="value">
+  /// Value to write.
+  /// </param>
+  /// <returns>
+  /// False if value is not stored.
+  /// </returns>
+  constexpr auto put_value_to_source(const Source& source, const Value value) {
+     return std::visit(overloaded {
+       [this, value](const DirectSource& s) {
+         regs[s.reg] = value;
+         return true;
+       },
+       [this, value](const IndirectSource& s) {
+         clk += memory.access(static_cast<std::size_t>(s.addr), true) - 1;
+         data[s.addr] = value;
+         return true;
+       },
+       [](const ImmidiateSource&) {
+         return false;
+       }
+      }, source);
+  }
+
+  /// <summary>
+  /// Execute writeback on current cycle or return
+  /// event for a next cycle.
+  /// Writeback might be executed on this cycle when result is stored 
+  /// in registers (DirectSoruce). 
+  /// Writeback to memoryr (IndirectSource) will take an extra cycle
+  /// to execute, so will return a Writeback event.
+  /// </summary>
+  /// <param name="value">
+  /// Result to store on this or next cycle.
+  /// </param>
+  /// <param name="res_addr">
+  /// Source where result is stored.
+  /// </param>
+  /// <returns>
+  /// Event to execute on next cycle.
+  /// If writeback is executed on this cycle, will return no_event.
+  /// </returns>
+  constexpr auto get_writeback(const Value value, const Source& res_addr) {
+    return std::visit(overloaded  {
+        [this, value](const DirectSource& s) {
+             put_value_to_source(s, value);
+             return no_event;
+        },
+        [value](const IndirectSource&) {
+             return make_event(EventKind::WRITEBACK, value);
+        },
+        [](const ImmidiateSource&) {
+             return make_exception(ExceptionCode::IMMIDIATE_RESULT);
+        }
+    }, res_addr);
+  }
+
+  /// <summary>
+  /// Calculate value on this cycle.
+  /// </summary>
+  /// <param name="i">
+  /// Instruction to execute.
+  /// </param>
+  /// <param name="op1">
+  /// First operand value.
+  /// </param>
+  /// <param name="op2">
+  /// Second operand value.
+  /// </param>
+  /// <returns>
+  /// Calculated value to store on this or next cycle.
+  /// </returns>
+  constexpr auto calculate_value(const Instruction&i, const Value op1, const Value op2) {
+    return std::visit(overloaded {
+        [op1](const UnaryInstruction& x) {
+          return UnaryInstruction::calculate(x, op1);
+        },
+        [op1, op2](const JumpInstruction& x) {
+          return JumpInstruction::calculate(x, op1 + op2);
+        },
+        [op1, op2](const BinaryInstruction& x) {
+          return BinaryInstruction::calculate(x, op1, op2);
+        }
+    }, i);
+  }
+
+  /// <summary>
+  /// Fetch second operand for an instruction on this cycle
+  /// if it's available. Return next cycle event to execute.
+  /// Might return Writeback event when opearand is available on this cycle
+  /// and could be calculated on this cycle and result should be stored on next event.
+  /// Might return no_event when writeback when operand is available on this cycle
+  /// and could be calculated on this cycle and result could be stored on this cycle.
+  /// Might return Op2Fetch event when operand is not available on this cycle and will take an 
+  /// extra cycle to fetch.
+  /// </summary>
+  /// <param name="ins">
+  /// Instruction to fetch second operand.
+  /// </param>
+  /// <param name="op1">
+  /// First operand value.
+  /// </param>
+  /// <returns>
+  /// Next cycle event.
+  /// Op2Fetch, Writeback or no_event
+  /// </returns>
+  constexpr auto get_fetch2(const Instruction& ins, const Value op1) {
+    const Source src = std::visit(overloaded {
+      [](const BinaryInstruction& i) -> Source {
+        return i.op2_addr;
+      },
+      [](const UnaryInstruction&) -> Source {
+          return DirectSource{0};
+      },
+      [](const JumpInstruction&) -> Source {
+          return DirectSource{0};
+      }
+    }, ins);
+    const Source res = std::visit(overloaded {
+        [](const BinaryInstruction& i) -> Source {
+          return i.res_addr;
+        },
+        [](const UnaryInstruction& i) -> Source {
+          return i.res_addr;
+        },
+        [](const JumpInstruction&) -> Source {
+          return DirectSource{0};
+        }
+    }, ins);
+    return std::visit(overloaded {
+      [this, &ins, op1, &res](const DirectSource& s) {
+        return get_writeback(calculate_value(ins, op1, static_cast<Value>(regs[s.reg])), res);
+      },
+      [this, &ins, op1, &res](const ImmidiateSource& s) {
+        return get_writeback(calculate_value(ins, op1, s.value), res);
+      },
+      [op1](const IndirectSource&) {
+        return make_event(EventKind::OP2_FETCH, op1);
+      }
+    }, src);
+  }
+
+  /// <summary>
+  /// Fetch first operand on this cycle if it's available.
+  /// Might return Op1Fetch when first operand is not available.
+  /// Might return Op2Fetch if first operand is available on this cycle
+  /// but second operand is not.
+  /// Might return Writeback if both operands are available on this cycle
+  /// but result couldn't be stored on this cycle.
+  /// Might return no_event if both operands are available on this cycle
+  /// and result could be stored on this cycle.
+  /// </summary>
+  /// <param name="ins">
+  /// Instruction to fetch first operand.
+  /// </param>
+  /// <returns>
+  /// Event for next cycle.
+  /// Op1Fetch, Op2Fetch, Writeback or no_event.
+  /// </returns>
+  constexpr auto get_fetch1(const Instruction& ins) {
+    const auto src = std::visit(overloaded {
+      [](const BinaryInstruction& i) {
+        return i.op1_addr;
+      },
+      [](const UnaryInstruction& i) {
+        return i.op1_addr;
+      },
+      [](const JumpInstruction& i) {
+        return i.offset_addr;
+      }
+    }, ins);
+    return std::visit(overloaded {
+       [this, &ins](const DirectSource& s) {
+           return get_fetch2(ins, static_cast<Value>(regs[s.reg]));
+       },
+       [this, &ins](const ImmidiateSource& s) {
+           return get_fetch2(ins, s.value);
+       },
+       [](const IndirectSource&) {
+         return make_event(EventKind::OP1_FETCH);
+       }
+    }, src);
+  }
+
+  /// <summary>
+  /// Execute Op1Fetch on this cycle and return next cycle event.
+  /// </summary>
+  /// <param name="ins">
+  /// Instruction in flight.
+  /// </param>
+  /// <returns>
+  /// Next cycle event for this instruction.
+  /// </returns>
+  constexpr auto handle_op1_fetch(const Instruction& ins) {
+    fetch1++;
+    return std::visit(overloaded {
+      [this, &ins](const BinaryInstruction& i) {
+          return get_fetch2(ins, read_value_from_source(i.op1_addr));
+      },
+      [this](const UnaryInstruction& i) {
+          return get_writeback(UnaryInstruction::calculate(i, read_value_from_source(i.op1_addr)), i.res_addr);
+      },
+      [this](const JumpInstruction& i) {
+          return make_event(EventKind::WRITEBACK, read_value_from_source(i.offset_addr));
+      }
+    }, ins);
+  }
+
+  /// <summary>
+  /// Execute Op2Fetch event on this cycle and get next cycle event.
+  /// </summary>
+  /// <param name="ins">
+  /// Instruction in flight.
+  /// </param>
+  /// <param name="event">
+  /// Op2Fetch event.
+  /// </param>
+  /// <returns>
+  /// Next cycle event for this instruction.
+  /// </returns>
+  constexpr auto handle_op2_fetch(const Instruction& ins, const Event& event) {
+    fetch2++;
+    return std::visit(overloaded {
+      [this, &event](const BinaryInstruction& i) {
+          return make_event(EventKind::WRITEBACK, BinaryInstruction::calculate(i, event.payload, read_value_from_source(i.op2_addr)));
+      },
+      [](const UnaryInstruction&) {
+          return make_exception(ExceptionCode::UNARY_OP2_FETCH);
+      },
+      [](const JumpInstruction&) {
+          return make_exception(ExceptionCode::JUMP_OP2_FETCH);
+      }
+    }, ins);
+  }
+
+  /// <summary>
+  /// Execute writeback event on this cycle.
+  /// </summary>
+  /// <param name="ins">
+  /// Instruction in flight.
+  /// </param>
+  /// <param name="event">
+  /// Writeback event.
+  /// </param>
+  /// <returns>
+  /// Next cycle event for this instruction.
+  /// Since writeback is final pipeline step, no_event
+  /// or Exception when result source is ImmidiateSource.
+  /// </returns>
+  constexpr auto handle_writeback(const Instruction& ins, const Event& event) {
+    writeback++;
+    const auto stored = std::visit(overloaded {
+      [this, &event] (const BinaryInstruction& i) {
+         return put_value_to_source(i.res_addr, event.payload);
+      },
+      [this, &event](const UnaryInstruction& i) {
+        return put_value_to_source(i.res_addr, event.payload);
+      },
+      [this, &event](const JumpInstruction&) {
+        return put_value_to_source(DirectSource{0}, event.payload);
+      }
+    }, ins);
+    return stored ? no_event : make_exception(ExceptionCode::IMMIDIATE_RESULT);
+  }
+
+  /// <summary>
+  /// Execute exception event on this cycle.
+  /// </summary>
+  /// <returns>
+  /// Next cycle event. 
+  /// Always no_event.
+  /// </returns>
+  constexpr auto handle_exception(const Event& event) {
+    exceptions++;
+    last_exception = static_cast<ExceptionCode>(event.payload);
+    return no_event;
+  }
+
+  /// <summary>
+  /// Execute pipeline while next cycle event is avilable after execution this event.
+  /// Every cycle passes only a small event to the next one, held in registers rather than memory.
+  /// A single instruction is in flight, so it's passed along by reference.
+  /// </summary>
+  /// <param name="ins">
+  /// Instruction in flight.
+  /// </param>
+  /// <param name="first">
+  /// Event to execute on cycle.
+  /// </param>
+  constexpr void handle_event(const Instruction& ins, const Event& first) {
+    for (auto event = first;;) {
+      clk++;
+#ifdef CYCLE_SIMULATOR_TRACE
+      if (trace) trace->record(clk, instructions, event);
+#endif
+      Event next = no_event;
+      switch (event.kind) {
+        case EventKind::OP1_FETCH: next = handle_op1_fetch(ins); break;
+        case EventKind::OP2_FETCH: next = handle_op2_fetch(ins, event); break;
+        case EventKind::WRITEBACK: next = handle_writeback(ins, event); break;
+        case EventKind::EXCEPTION: next = handle_exception(event); break;
+        case EventKind::NONE: break;
+      }
+      if (next.kind == EventKind::NONE) return;
+      event = next;
+    }
+  }
+
+  /// <summary>
+  /// Execute instruction.
+  /// </summary>
+  /// <param name="i">
+  /// Instruction to execute.
+  /// </param>
+  /// <returns>
+  /// Nothing.
+  /// </returns>
+  constexpr auto execute(const Instruction& i) {
+    clk++; // instruction fetch+decode cycle
+#ifdef CYCLE_SIMULATOR_TRACE
+    if (trace) trace->record(clk, instructions);
+#endif
+    const auto event = get_fetch1(i);
+    if (event.kind != EventKind::NONE)
+      handle_event(i, event);
+#ifdef CYCLE_SIMULATOR_TRACE
+    instructions++;
+#endif
+  }
+
+  /// <summary>
+  /// Execute program repeated from the start while budget lasts.
+  /// Program is walked pass by pass without per-instruction index wrapping,
+  /// limit checks are skipped entirely when budget doesn't ask for them.
+  /// </summary>
+  /// <param name="program">
+  /// Program to execute.
+  /// </param>
+  /// <param name="budget">
+  /// Limits of run, unlimited by default.
+  /// </param>
+  /// <param name="first">
+  /// Index of the first instruction to execute, RunResult::next of a stopped run resumes it.
+  /// </param>
+  /// <returns>
+  /// Count of executed instructions and spent cycles, the reason run stopped and where to resume it.
+  /// </returns>
+  constexpr auto run(std::span<const Instruction> program, const RunBudget& budget = {}, const std::size_t first = 0) {
+    const auto start = clk;
+    RunResult result {0, 0, StopReason::INSTRUCTIONS, std::nullopt, 0};
+    if (program.empty()) return result;
+    auto position = first % program.size();
+    const auto stop = [this, &result, &position, start](const StopReason reason) {
+      result.cycles = clk - start;
+      result.reason = reason;
+      result.next = position;
+      if (reason == StopReason::EXCEPTION) result.exception = last_exception;
+      return result;
+    };
+    RunGuard guard {budget, clk};
+    if (guard.checked) {
+      if (const auto reason = guard.initial(clk)) return stop(*reason);
+    }
+    while (result.executed < budget.instructions) {
+      const auto n = std::min(budget.instructions - result.executed, program.size() - position);
+      for (std::size_t i = 0; i < n; i++) {
+        const auto raised = exceptions;
+        execute(program[position + i]);
+        if (!guard.checked) continue;
+        if (const auto reason = guard.check(clk, exceptions != raised)) {
+          result.executed += i + 1;
+          position = (position + i + 1) % program.size();
+          return stop(*reason);
+        }
+      }
+      result.executed += n;
+      position = (position + n) % program.size();
+    }
+    return stop(StopReason::INSTRUCTIONS);
+  }
+
+  /// <summary>
+  /// Execute program by program counter while budget lasts or until it halts.
+  /// </summary>
+  /// <param name="program">
+  /// Program to execute from the current program counter.
+  /// </param>
+  /// <param name="budget">
+  /// Limits of run, unlimited by default.
+  /// </param>
+  /// <returns>
+  /// Count of executed instructions and spent cycles, the reason run stopped and program counter to resume from.
+  /// </returns>
+  constexpr auto run_steps(std::span<const Instruction> program, const RunBudget& budget = {}) {
+    const auto start = clk;
+    RunResult result {0, 0, StopReason::INSTRUCTIONS, std::nullopt, pc};
+    const auto stop = [this, &result, start](const StopReason reason) {
+      result.cycles = clk - start;
+      result.reason = reason;
+      result.next = pc;
+      if (reason == StopReason::EXCEPTION) result.exception = last_exception;
+      return result;
+    };
+    if (pc >= program.size()) return stop(StopReason::HALTED);
+    RunGuard guard {budget, clk};
+    if (guard.checked) {
+      if (const auto reason = guard.initial(clk)) return stop(*reason);
+    }
+    while (result.executed < budget.instructions) {
+      const auto raised = exceptions;
+      const auto running = step(program);
+      result.executed++;
+      // exception of the last instruction of a halting program is still reported
+      if (budget.stop_on_exception && exceptions != raised) return stop(StopReason::EXCEPTION);
+      if (!running) return stop(StopReason::HALTED);
+      if (!guard.checked) continue;
+      if (const auto reason = guard.check(clk, exceptions != raised)) return stop(*reason);
+    }
+    return stop(StopReason::INSTRUCTIONS);
+  }
+
+  /// <summary>
+  /// Execute instruction at program counter and move program counter.
+  /// JumpInstruction moves program counter by its offset relative to itself,
+  /// register and memory offsets are unsigned, immidiate offsets are signed.
+  /// Jump still stores its result into regs[0].
+  /// Mispredicted jump costs branch target buffer penalty cycles.
+  /// </summary>
+  /// <param name="program">
+  /// Program to execute.
+  /// </param>
+  /// <returns>
+  /// False when program counter is out of program and program is halted.
+  /// </returns>
+  constexpr auto step(std::span<const Instruction> program) {
+    if (pc >= program.size()) return false;
+    const auto& ins = program[pc];
+    const auto* jump = std::get_if<JumpInstruction>(&ins);
+    const auto offset = jump ? peek_value_from_source(jump->offset_addr) : 0;
+    execute(ins);
+    if (jump) {
+      const auto target = jump_target(pc, offset);
+      clk += btb.predict(pc, target);
+      pc = target;
+    } else {
+      pc++;
+    }
+    return pc < program.size();
+  }
+
+};
+
+typedef BasicState<> State;
+
+/// <summary>
+/// Tiny microcontroller: 8 registers and 256 B of RAM.
+/// </summary>
+typedef BasicState<8, 256, std::uint8_t> MicrocontrollerState;
+
+/// <summary>
+/// Large address space: every non-negative IndirectSource address is valid,
+/// memory is allocated by 4 KiB pages on first touch.
+/// </summary>
+typedef BasicState<16, std::size_t {1} << 31, MachineWord, FlatMemory, PagedMemory<MachineWord>> SparseState;
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef threaded_h_
+#define threaded_h_
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <utility>
+
+#include "state.h"
+#include "decoded.h"
+
+// Handlers dispatch the next handler by a guaranteed tail call where compiler supports it,
+// so execution jumps from handler to handler without returning into a dispatch loop.
+// Otherwise engine is call-threaded: a loop calls handler of every instruction.
+#if defined(__clang__) && defined(__has_cpp_attribute)
+#if __has_cpp_attribute(clang::musttail)
+#define THREADED_MUSTTAIL [[clang::musttail]]
+#endif
+#elif defined(__GNUC__) && defined(__has_attribute)
+#if __has_attribute(musttail)
+#define THREADED_MUSTTAIL __attribute__((musttail))
+#endif
+#endif
+
+struct ThreadedOp;
+
+/// <summary>
+/// Handler of a single operation and addressing modes combination.
+/// Executes count of instructions starting from op, the first one is its own.
+/// </summary>
+typedef void (*Handler)(State&, const ThreadedOp* op, std::size_t count);
+
+/// <summary>
+/// Threaded instruction: handler address and operand values.
+/// Operation, addressing modes and cycle cost are encoded by handler itself.
+/// </summary>
+struct ThreadedOp {
+  Handler handler;
+  Value op1;
+  Value op2;
+  int res;
+};
+
+template<SourceKind Kind>
+constexpr auto load(const State& state, const Value value) {
+  if constexpr (Kind == SourceKind::DIRECT) {
+    return static_cast<Value>(state.regs[value]);
+  } else if constexpr (Kind == SourceKind::INDIRECT) {
+    return static_cast<Value>(state.data[value]);
+  } else {
+    return value;
+  }
+}
+
+template<SourceKind Kind>
+constexpr auto store(State& state, const int addr, const Value value) {
+  if constexpr (Kind == SourceKind::DIRECT) {
+    state.regs[addr] = value;
+  } else if constexpr (Kind == SourceKind::INDIRECT) {
+    state.data[addr] = value;
+  }
+}
+
+/// <summary>
+/// Execute threaded instruction with operation and addressing modes known at compile time
+/// and tail call handler of the next one while count lasts.
+/// Registers, memory and metrics are changed exactly as State::execute does.
+/// </summary>
+template<OpCode Op, SourceKind Op1, SourceKind Op2, SourceKind Res>
+void handle(State& state, const ThreadedOp* op, const std::size_t count) {
+  constexpr auto cost = cost_of(Op, Op1, Op2, Res);
+  state.clk += cost.clk;
+  if constexpr (cost.fetch1 > 0) state.fetch1 += cost.fetch1;
+  if constexpr (cost.fetch2 > 0) state.fetch2 += cost.fetch2;
+  if constexpr (cost.writeback > 0) state.writeback += cost.writeback;
+  if constexpr (cost.exceptions > 0) state.exceptions += cost.exceptions;
+
+  store<Res>(state, op->res, alu<alu_operation(Op)>(load<Op1>(state, op->op1), load<Op2>(state, op->op2)));
+#ifdef THREADED_MUSTTAIL
+  if (count > 1) THREADED_MUSTTAIL return op[1].handler(state, op + 1, count - 1);
+#else
+  static_cast<void>(count);
+#endif
+}
+
+constexpr std::size_t source_kinds = 3;
+
+constexpr auto handler_index(const OpCode op, const SourceKind op1, const SourceKind op2, const SourceKind res) {
+  return ((static_cast<std::size_t>(op) * source_kinds + static_cast<std::size_t>(op1)) * source_kinds
+          + static_cast<std::size_t>(op2)) * source_kinds + static_cast<std::size_t>(res);
+}
+
+template<std::size_t Index>
+constexpr auto handler_at() -> Handler {
+  constexpr auto res = static_cast<SourceKind>(Index % source_kinds);
+  constexpr auto op2 = static_cast<SourceKind>(Index / source_kinds % source_kinds);
+  constexpr auto op1 = static_cast<SourceKind>(Index / source_kinds / source_kinds % source_kinds);
+  constexpr auto op = static_cast<OpCode>(Index / source_kinds / source_kinds / source_kinds);
+  static_assert(handler_index(op, op1, op2, res) == Index);
+  return &handle<op, op1, op2, res>;
+}
+
+template<std::size_t... Is>
+constexpr auto make_handlers(std::index_sequence<Is...>) {
+  return std::array<Handler, sizeof...(Is)> {handler_at<Is>()...};
+}
+
+/// <summary>
+/// Handler for every operation and addressing modes combination.
+/// </summary>
+inline constexpr auto handlers = make_handlers(std::make_index_sequence<op_codes * source_kinds * source_kinds * source_kinds>{});
+
+/// <summary>
+/// Compile instruction into threaded instruction.
+/// </summary>
+constexpr auto compile(const Instruction& ins) {
+  const auto op = decode(ins);
+  return ThreadedOp {handlers[handler_index(op.op, op.op1_kind, op.op2_kind, op.res_kind)], op.op1, op.op2, op.res};
+}
+
+template<std::size_t N>
+constexpr auto compile(const std::array<Instruction, N>& program) {
+  std::array<ThreadedOp, N> ops{};
+  for (std::size_t i = 0; i < N; i++)
+    ops[i] = compile(program[i]);
+  return ops;
+}
+
+/// <summary>
+/// Execute program by threaded dispatch: a pass is a single chain of tail calls of handlers
+/// when compiler guarantees tail calls, otherwise handler of each instruction is called by a loop.
+/// </summary>
+/// <param name="state">
+/// State to execute on.
+/// </param>
+/// <param name="program">
+/// Compiled program.
+/// </param>
+/// <param name="count">
+/// Count of instructions to execute, program is repeated from the start when ends.
+/// </param>
+inline auto run(State& state, std::span<const ThreadedOp> program, const std::size_t count) {
+  if (program.empty()) return;
+#ifdef THREADED_MUSTTAIL
+  for (std::size_t pass = 0; pass < count / program.size(); pass++)
+    program[0].handler(state, program.data(), program.size());
+  if (count % program.size() > 0)
+    program[0].handler(state, program.data(), count % program.size());
+#else
+  repeat(program, count, [&state](const ThreadedOp& op) { op.handler(state, &op, 1); });
+#endif
+}
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef trace_h_
+#define trace_h_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#include "utilities.h"
+#include "source.h"
+#include "instruction.h"
+#include "event.h"
+
+enum struct TraceStage : std::uint8_t {
+  DECODE,
+  OP1_FETCH,
+  OP2_FETCH,
+  EXECUTION,
+  WRITEBACK,
+  EXCEPTION
+};
+
+/// <summary>
+/// Trace record of a single pipeline cycle.
+/// Value is the one carried by event of cycle: op1 for Op2Fetch, result for Writeback,
+/// ExceptionCode for Exception, zero otherwise, truncated to 32 bits for wider words.
+/// Second value slot is reserved and always written as zero.
+/// Sequential engine has no separate Execution cycle, so EXECUTION stage is never recorded.
+/// </summary>
+struct TraceRecord {
+  std::uint64_t cycle;
+  std::uint32_t index;
+  TraceStage stage;
+  std::uint8_t reserved[3];
+  std::int32_t value;
+  std::int32_t reserved2;
+};
+
+static_assert(sizeof(TraceRecord) == 24);
+static_assert(std::is_trivially_copyable_v<TraceRecord>);
+
+constexpr auto trace_record(const std::size_t cycle, const std::size_t index, const Event& event) {
+  constexpr TraceStage stages[] {TraceStage::OP1_FETCH, TraceStage::OP2_FETCH, TraceStage::WRITEBACK, TraceStage::EXCEPTION};
+  TraceRecord record {cycle, static_cast<std::uint32_t>(index), stages[static_cast<std::size_t>(event.kind)], {},
+                        static_cast<std::int32_t>(event.payload), 0};
+  return record;
+}
+
+/// <summary>
+/// Lock-free single producer single consumer ring buffer of trace records.
+/// </summary>
+template<std::size_t Capacity>
+struct TraceRing {
+  static_assert((Capacity & (Capacity - 1)) == 0, "capacity should be a power of two");
+
+  alignas(64) std::atomic<std::size_t> head{0};
+  /// <summary>
+  /// Consumer position last seen by producer, reloaded only when ring looks full.
+  /// </summary>
+  std::size_t cached_tail{0};
+  alignas(64) std::atomic<std::size_t> tail{0};
+  alignas(64) TraceRecord records[Capacity];
+
+  /// <summary>
+  /// Push record, waiting for consumer while ring is full.
+  /// </summary>
+  auto push(const TraceRecord& record) {
+    const auto h = head.load(std::memory_order_relaxed);
+    if (h - cached_tail == Capacity) [[unlikely]] {
+      while (h - (cached_tail = tail.load(std::memory_order_acquire)) == Capacity)
+        std::this_thread::yield();
+    }
+    records[h & (Capacity - 1)] = record;
+    head.store(h + 1, std::memory_order_release);
+  }
+
+  /// <summary>
+  /// Get contiguous range of records available to consumer.
+  /// </summary>
+  /// <returns>
+  /// Pointer to first record and count of records.
+  /// </returns>
+  auto peek(std::size_t& count) const -> const TraceRecord* {
+    const auto t = tail.load(std::memory_order_relaxed);
+    const auto h = head.load(std::memory_order_acquire);
+    const auto offset = t & (Capacity - 1);
+    count = std::min(h - t, Capacity - offset);
+    return &records[offset];
+  }
+
+  auto pop(const std::size_t count) {
+    tail.store(tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+  }
+};
+
+/// <summary>
+/// Binary trace sink.
+/// State pushes records into ring buffer, background thread collects them
+/// into an aligned buffer and writes it to file by large blocks.
+/// </summary>
+struct TraceWriter {
+  static constexpr std::size_t ring_capacity = 1 << 16;
+  /// <summary>
+  /// Size of a single write, multiple of both record size and page size.
+  /// </summary>
+  static constexpr std::size_t block_size = sizeof(TraceRecord) << 16;
+
+  std::unique_ptr<TraceRing<ring_capacity>> ring {std::make_unique<TraceRing<ring_capacity>>()};
+  std::FILE* file{nullptr};
+  std::atomic<bool> running{true};
+  std::thread thread;
+
+  explicit TraceWriter(const std::string& path) {
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) throw std::runtime_error{"unable to open " + path};
+    std::setvbuf(file, nullptr, _IONBF, 0);
+    thread = std::thread {[this] { drain(); }};
+  }
+
+  TraceWriter(const TraceWriter&) = delete;
+  TraceWriter& operator=(const TraceWriter&) = delete;
+
+  ~TraceWriter() {
+    running.store(false, std::memory_order_release);
+    thread.join();
+    std::fclose(file);
+  }
+
+  auto record(const std::size_t cycle, const std::size_t index, const Event& event) {
+    ring->push(trace_record(cycle, index, event));
+  }
+
+  auto record(const std::size_t cycle, const std::size_t index) {
+    ring->push(TraceRecord {cycle, static_cast<std::uint32_t>(index), TraceStage::DECODE, {}, 0, 0});
+  }
+
+  /// <summary>
+  /// Background thread loop: move records from ring into block and write full blocks.
+  /// </summary>
+  auto drain() -> void {
+    struct Free {
+      auto operator()(void* p) const { ::operator delete(p, std::align_val_t{4096}); }
+    };
+    std::unique_ptr<void, Free> memory {::operator new(block_size, std::align_val_t{4096})};
+    auto* block = static_cast<std::uint8_t*>(memory.get());
+    std::size_t used = 0;
+    for (;;) {
+      const auto stopping = !running.load(std::memory_order_acquire);
+      std::size_t count = 0;
+      const auto* records = ring->peek(count);
+      if (count == 0) {
+        if (stopping) break;
+        std::this_thread::sleep_for(std::chrono::microseconds{50});
+        continue;
+      }
+      count = std::min(count, (block_size - used) / sizeof(TraceRecord));
+      std::memcpy(block + used, records, count * sizeof(TraceRecord));
+      ring->pop(count);
+      used += count * sizeof(TraceRecord);
+      if (used == block_size) {
+        std::fwrite(block, 1, used, file);
+        used = 0;
+      }
+    }
+    if (used > 0) std::fwrite(block, 1, used, file);
+  }
+};
+
+#endif
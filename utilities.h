@@ -1,9 +1,15 @@
 #ifndef utilities_h_
 #define utilities_h_
 
+#include <charconv>
 #include <concepts>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <system_error>
 #include <type_traits>
 #include <cstdio>
+#include <span>
 
 template<typename T>
 concept BooleanConvertible = std::is_convertible_v<T, bool>;
@@ -13,12 +19,42 @@ template<class... Ts> struct overloaded : Ts... { using Ts::operator()...; };
 // explicit deduction guide (not needed as of C++20)
 template<class... Ts> overloaded(Ts...)->overloaded<Ts...>;
 
+/// <summary>
+/// Call function for count of program items, program is repeated from the start when ends.
+/// </summary>
+template<typename T, typename F>
+constexpr auto repeat(std::span<T> program, const std::size_t count, F&& f) {
+  if (program.empty()) return;
+  for (std::size_t pass = 0; pass < count / program.size(); pass++) {
+    for (auto& item : program)
+      f(item);
+  }
+  for (std::size_t i = 0; i < count % program.size(); i++)
+    f(program[i]);
+}
+
+/// <summary>
+/// Parse unsigned number of a command line option value.
+/// </summary>
+/// <returns>
+/// Number or empty optional when value isn't a number as a whole.
+/// </returns>
+inline auto parse_number(const std::string_view value) -> std::optional<std::size_t> {
+  std::size_t number = 0;
+  const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), number);
+  if (ec != std::errc{} || end != value.data() + value.size()) return std::optional<std::size_t>{};
+  return number;
+}
+
+/// <summary>
+/// Print words in hex, bytes are grouped by two and wider words are separated.
+/// </summary>
 template<typename T>
 inline auto hexdump(const T* data, const std::size_t size) {
   for (std::size_t i = 0; i < size; i++) {
     if (i > 0 && i % 16 == 0) fprintf(stderr, "\n");
-    if (i > 0 && i % 2 == 0) fprintf(stderr, " ");
-    fprintf(stderr, "%02x", data[i]);
+    if (i > 0 && (sizeof(T) > 1 || i % 2 == 0)) fprintf(stderr, " ");
+    fprintf(stderr, "%0*llx", static_cast<int>(sizeof(T) * 2), static_cast<unsigned long long>(data[i]));
   }
   fprintf(stderr, "\n");
 }
@@ -0,0 +1,73 @@
+#ifndef word_h_
+#define word_h_
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Word width of registers, memory and Source values is selected at compile time
+// by CYCLE_SIMULATOR_WORD_BITS: 8, 16, 32 or 64 bits, 8 by default.
+
+#ifndef CYCLE_SIMULATOR_WORD_BITS
+#define CYCLE_SIMULATOR_WORD_BITS 8
+#endif
+
+template<std::size_t Bits>
+struct WordTraits;
+
+template<>
+struct WordTraits<8> {
+  typedef std::uint8_t word_type;
+  typedef int value_type;
+};
+
+template<>
+struct WordTraits<16> {
+  typedef std::uint16_t word_type;
+  typedef int value_type;
+};
+
+template<>
+struct WordTraits<32> {
+  typedef std::uint32_t word_type;
+  typedef std::int64_t value_type;
+};
+
+template<>
+struct WordTraits<64> {
+  typedef std::uint64_t word_type;
+  typedef std::int64_t value_type;
+};
+
+constexpr std::size_t word_bits = CYCLE_SIMULATOR_WORD_BITS;
+
+/// <summary>
+/// Unsigned storage of registers and memory.
+/// </summary>
+typedef WordTraits<word_bits>::word_type MachineWord;
+
+/// <summary>
+/// Signed value of Source and calculations, holds any word.
+/// </summary>
+typedef WordTraits<word_bits>::value_type Value;
+
+static_assert(sizeof(Value) * 8 >= word_bits);
+
+/// <summary>
+/// Two's complement addition of values.
+/// Results are truncated into words on store, so wrapped sum of 64 bit words stores the same word as exact one.
+/// </summary>
+constexpr auto wrapping_add(const Value a, const Value b) {
+  typedef std::make_unsigned_t<Value> Unsigned;
+  return static_cast<Value>(static_cast<Unsigned>(a) + static_cast<Unsigned>(b));
+}
+
+/// <summary>
+/// Two's complement subtraction of values.
+/// </summary>
+constexpr auto wrapping_sub(const Value a, const Value b) {
+  typedef std::make_unsigned_t<Value> Unsigned;
+  return static_cast<Value>(static_cast<Unsigned>(a) - static_cast<Unsigned>(b));
+}
+
+#endif